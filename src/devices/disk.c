@@ -7,9 +7,26 @@
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   A request for several consecutive sectors is issued as a single
+   command.  If the PCI IDE controller supports bus mastering, the
+   controller moves the data itself by DMA and interrupts once per
+   command; otherwise the data is moved by PIO, one interrupt per
+   sector.
+
+   Requests are submitted asynchronously with disk_submit() to a
+   queue per channel.  Each channel's dispatcher thread serves its
+   queue in C-LOOK order: it sweeps upward from the last sector
+   served to the highest requested, then jumps back to the lowest.
+   Requests that continue the one being dispatched, on the same
+   disk and in the same direction, are merged into its command.
+   disk_read() and the other synchronous calls submit a request
+   and wait for it. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -28,10 +45,25 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses, relative to the base in the
+   PCI IDE controller's BAR4. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0)  /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)   /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)     /* PRD table. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus Master Command Register bits. */
+#define BM_START 0x01           /* Start transfer. */
+#define BM_READ 0x08            /* Transfer from disk to memory. */
+
+/* Bus Master Status Register bits. */
+#define BM_STA_ERR 0x02         /* Error (write 1 to clear). */
+#define BM_STA_INTR 0x04        /* Interrupt (write 1 to clear). */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,6 +79,25 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Most sectors moved by one command, as the Sector Count
+   register allows, and most requests merged into one. */
+#define COMMAND_MAX 256
+#define MERGE_MAX 16
+
+/* Physical Region Descriptor, one entry in the table that tells
+   the bus master where in memory a DMA transfer goes.  A region
+   must not cross a 64 kB boundary; a size of 0 means 64 kB. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address of region. */
+    uint16_t size;              /* Size of region in bytes. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (2 * MERGE_MAX) /* Entries per table. */
 
 /* An ATA device. */
 struct disk 
@@ -57,9 +108,12 @@ struct disk
 
     bool is_ata;                /* 1=This device is an ATA disk. */
     disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
+    bool use_dma;               /* Transfer data by bus master DMA? */
 
     long long read_cnt;         /* Number of sectors read. */
     long long write_cnt;        /* Number of sectors written. */
+    long long command_cnt;      /* Number of read and write commands. */
+    long long interrupt_cnt;    /* Number of completion interrupts. */
   };
 
 /* An ATA channel (aka controller).
@@ -69,25 +123,49 @@ struct channel
     char name[8];               /* Name, e.g. "hd0". */
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
+    uint16_t bm_base;           /* Bus master I/O port, or 0 if none. */
+    struct prd *prdt;           /* PRD table for DMA transfers. */
 
-    struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    struct lock lock;           /* Guards QUEUE. */
+    struct condition queue_nonempty;    /* Signaled when QUEUE fills. */
+    struct list queue;          /* Requests waiting to be dispatched. */
+    size_t queue_len;           /* Number of requests in QUEUE. */
+    uint64_t cursor;            /* Elevator position; see request_key(). */
+
     struct disk devices[2];     /* The devices on this channel. */
+
+    /* Statistics. */
+    long long dispatch_cnt;     /* Commands dispatched. */
+    long long depth_total;      /* Sum of queue lengths at dispatch. */
+    size_t depth_max;           /* Longest queue at dispatch. */
+    long long merge_cnt;        /* Requests merged into another's command. */
+    long long request_cnt;      /* Requests completed. */
+    long long wait_ticks;       /* Their total time queued. */
+    long long service_ticks;    /* Their total time being served. */
   };
 
 /* We support the two "legacy" ATA channels found in a standard PC. */
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
+/* PRD tables, one per channel.  Aligned to their size, so that
+   none crosses a 64 kB boundary, as the bus master requires. */
+static struct prd prd_tables[CHANNEL_CNT][PRD_CNT]
+  __attribute__ ((aligned (CHANNEL_CNT * PRD_CNT * sizeof (struct prd))));
+
+static uint16_t find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
-static void issue_pio_command (struct channel *, uint8_t command);
+static thread_func dispatcher;
+static void transfer (struct disk_request **, size_t cnt);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
+static void issue_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
@@ -102,6 +180,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 disk_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -124,9 +203,18 @@ disk_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
+      c->bm_base = bm_base != 0 ? bm_base + 8 * chan_no : 0;
+      c->prdt = prd_tables[chan_no];
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      lock_init (&c->lock);
+      cond_init (&c->queue_nonempty);
+      list_init (&c->queue);
+      c->queue_len = 0;
+      c->cursor = 0;
+      c->dispatch_cnt = c->depth_total = c->merge_cnt = 0;
+      c->depth_max = 0;
+      c->request_cnt = c->wait_ticks = c->service_ticks = 0;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -138,8 +226,10 @@ disk_init (void)
 
           d->is_ata = false;
           d->capacity = 0;
+          d->use_dma = false;
 
           d->read_cnt = d->write_cnt = 0;
+          d->command_cnt = d->interrupt_cnt = 0;
         }
 
       /* Register interrupt handler. */
@@ -156,6 +246,14 @@ disk_init (void)
       for (dev_no = 0; dev_no < 2; dev_no++)
         if (c->devices[dev_no].is_ata)
           identify_ata_device (&c->devices[dev_no]);
+
+      /* Serve requests from here on. */
+      if (c->devices[0].is_ata || c->devices[1].is_ata)
+        {
+          char name[16];
+          snprintf (name, sizeof name, "%s-io", c->name);
+          thread_create (name, PRI_MAX, dispatcher, c);
+        }
     }
 }
 
@@ -167,15 +265,33 @@ disk_print_stats (void)
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) 
     {
+      struct channel *c = &channels[chan_no];
       int dev_no;
 
       for (dev_no = 0; dev_no < 2; dev_no++) 
         {
           struct disk *d = disk_get (chan_no, dev_no);
           if (d != NULL && d->is_ata) 
-            printf ("%s: %lld reads, %lld writes\n",
-                    d->name, d->read_cnt, d->write_cnt);
+            printf ("%s: %lld reads, %lld writes, %lld commands, "
+                    "%lld interrupts (%s)\n",
+                    d->name, d->read_cnt, d->write_cnt, d->command_cnt,
+                    d->interrupt_cnt, d->use_dma ? "DMA" : "PIO");
         }
+
+      /* Times are kept in timer ticks, so averages are in
+         hundredths of a tick. */
+      if (c->request_cnt > 0)
+        printf ("%s: queue depth %lld.%02lld average, %zu max, "
+                "%lld merges, service %lld.%02lld ticks, "
+                "wait %lld.%02lld ticks\n",
+                c->name,
+                c->depth_total / c->dispatch_cnt,
+                c->depth_total * 100 / c->dispatch_cnt % 100,
+                c->depth_max, c->merge_cnt,
+                c->service_ticks / c->request_cnt,
+                c->service_ticks * 100 / c->request_cnt % 100,
+                c->wait_ticks / c->request_cnt,
+                c->wait_ticks * 100 / c->request_cnt % 100);
     }
 }
 
@@ -219,21 +335,7 @@ disk_size (struct disk *d)
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) 
 {
-  struct channel *c;
-  
-  ASSERT (d != NULL);
-  ASSERT (buffer != NULL);
-
-  c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  d->read_cnt++;
-  lock_release (&c->lock);
+  disk_read_multiple (d, sec_no, 1, buffer);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -244,27 +346,274 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer)
 void
 disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
 {
-  struct channel *c;
-  
+  disk_write_multiple (d, sec_no, 1, buffer);
+}
+
+/* Wakes up the submitter of synchronous request R. */
+static void
+wake_submitter (struct disk_request *r)
+{
+  sema_up (r->aux);
+}
+
+/* Moves CNT sectors starting at SEC_NO between disk D and BUFFER,
+   writing BUFFER to the disk if WRITE and otherwise reading into
+   it, and waits until they have been moved. */
+static void
+transfer_sync (struct disk *d, disk_sector_t sec_no, size_t cnt,
+               void *buffer_, bool write)
+{
+  uint8_t *buffer = buffer_;
+  struct disk_request r;
+  struct semaphore done;
+
   ASSERT (d != NULL);
   ASSERT (buffer != NULL);
 
-  c = d->channel;
+  sema_init (&done, 0);
+  while (cnt > 0)
+    {
+      r.disk = d;
+      r.sector = sec_no;
+      r.cnt = cnt < DISK_REQUEST_MAX ? cnt : DISK_REQUEST_MAX;
+      r.buffer = buffer;
+      r.write = write;
+      r.aux = &done;
+      disk_submit (&r, wake_submitter);
+      sema_down (&done);
+
+      sec_no += r.cnt;
+      buffer += r.cnt * DISK_SECTOR_SIZE;
+      cnt -= r.cnt;
+    }
+}
+
+/* Reads CNT consecutive sectors starting at SEC_NO from disk D
+   into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes, using as few commands as possible.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_multiple (struct disk *d, disk_sector_t sec_no, size_t cnt,
+                    void *buffer)
+{
+  transfer_sync (d, sec_no, cnt, buffer, false);
+}
+
+/* Writes CNT consecutive sectors starting at SEC_NO to disk D
+   from BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes,
+   using as few commands as possible.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write_multiple (struct disk *d, disk_sector_t sec_no, size_t cnt,
+                     const void *buffer)
+{
+  transfer_sync (d, sec_no, cnt, (void *) buffer, true);
+}
+
+/* Queues request R and returns at once.  CALLBACK is called with
+   R, from the channel's dispatcher thread, once R has completed.
+   It should not block for long, since it holds up the channel. */
+void
+disk_submit (struct disk_request *r, disk_callback *callback)
+{
+  struct channel *c;
+
+  ASSERT (r != NULL && r->disk != NULL && r->buffer != NULL);
+  ASSERT (r->cnt > 0 && r->cnt <= DISK_REQUEST_MAX);
+  ASSERT (r->sector < r->disk->capacity
+          && r->cnt <= r->disk->capacity - r->sector);
+
+  r->callback = callback;
+  r->submit_time = timer_ticks ();
+
+  c = r->disk->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  d->write_cnt++;
+  list_push_back (&c->queue, &r->elem);
+  c->queue_len++;
+  cond_signal (&c->queue_nonempty, &c->lock);
   lock_release (&c->lock);
 }
-
+
+/* Returns R's position along the elevator's sweep: by disk, then
+   by sector. */
+static uint64_t
+request_key (const struct disk_request *r)
+{
+  return ((uint64_t) r->disk->dev_no << 32) | r->sector;
+}
+
+/* Removes the next request from channel C's queue in C-LOOK
+   order, along with up to MERGE_MAX - 1 more that continue it,
+   and stores them into BATCH in sector order.  Returns the number
+   stored.  Must be called with C's lock held and the queue not
+   empty. */
+static size_t
+take_batch (struct channel *c, struct disk_request *batch[MERGE_MAX])
+{
+  struct disk_request *first = NULL, *lowest = NULL;
+  struct list_elem *e;
+  size_t n, sectors;
+
+  ASSERT (!list_empty (&c->queue));
+
+  /* The first request at or beyond the cursor, or failing that the
+     lowest of all. */
+  for (e = list_begin (&c->queue); e != list_end (&c->queue);
+       e = list_next (e))
+    {
+      struct disk_request *r = list_entry (e, struct disk_request, elem);
+      uint64_t key = request_key (r);
+
+      if (key >= c->cursor
+          && (first == NULL || key < request_key (first)))
+        first = r;
+      if (lowest == NULL || key < request_key (lowest))
+        lowest = r;
+    }
+  if (first == NULL)
+    first = lowest;
+
+  c->dispatch_cnt++;
+  c->depth_total += c->queue_len;
+  if (c->queue_len > c->depth_max)
+    c->depth_max = c->queue_len;
+
+  list_remove (&first->elem);
+  c->queue_len--;
+  batch[0] = first;
+  n = 1;
+  sectors = first->cnt;
+
+  /* Merge in requests that pick up where the batch leaves off. */
+  while (n < MERGE_MAX)
+    {
+      struct disk_request *last = batch[n - 1];
+      disk_sector_t next = last->sector + last->cnt;
+      struct disk_request *r = NULL;
+
+      for (e = list_begin (&c->queue); e != list_end (&c->queue);
+           e = list_next (e))
+        {
+          r = list_entry (e, struct disk_request, elem);
+          if (r->disk == first->disk && r->write == first->write
+              && r->sector == next && sectors + r->cnt <= COMMAND_MAX)
+            break;
+        }
+      if (e == list_end (&c->queue))
+        break;
+
+      list_remove (&r->elem);
+      c->queue_len--;
+      batch[n++] = r;
+      sectors += r->cnt;
+      c->merge_cnt++;
+    }
+
+  c->cursor = request_key (batch[n - 1]) + batch[n - 1]->cnt;
+  return n;
+}
+
+/* Serves the request queue of channel C_, one command at a time.
+   No one else touches the controller once this thread runs. */
+static void
+dispatcher (void *c_)
+{
+  struct channel *c = c_;
+
+  for (;;)
+    {
+      struct disk_request *batch[MERGE_MAX];
+      int64_t start, end;
+      size_t n, i;
+
+      lock_acquire (&c->lock);
+      while (list_empty (&c->queue))
+        cond_wait (&c->queue_nonempty, &c->lock);
+      n = take_batch (c, batch);
+      lock_release (&c->lock);
+
+      start = timer_ticks ();
+      transfer (batch, n);
+      end = timer_ticks ();
+
+      for (i = 0; i < n; i++)
+        {
+          struct disk_request *r = batch[i];
+
+          c->request_cnt++;
+          c->wait_ticks += start - r->submit_time;
+          c->service_ticks += end - start;
+          r->callback (r);
+        }
+    }
+}
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
 
+/* PCI configuration space access ports. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Returns register REG of the configuration space of PCI device
+   DEV, function FUNC, on bus 0. */
+static uint32_t
+pci_read_config (int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Sets register REG of the configuration space of PCI device DEV,
+   function FUNC, on bus 0, to DATA. */
+static void
+pci_write_config (int dev, int func, int reg, uint32_t data)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+  outl (PCI_CONFIG_DATA, data);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that can act as a bus
+   master, as the PIIX controllers emulated by Bochs and QEMU can,
+   and enables bus mastering on it.  Returns the I/O port of its
+   primary channel's bus master registers (the secondary
+   channel's follow 8 ports later), or 0 if there is none. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class, bar4;
+
+        if ((pci_read_config (dev, func, 0x00) & 0xffff) == 0xffff)
+          continue;
+
+        /* Mass storage, IDE, with bus master capability. */
+        class = pci_read_config (dev, func, 0x08);
+        if ((class >> 16) != 0x0101 || (class & 0x8000) == 0)
+          continue;
+
+        /* BAR4 must be an I/O space address. */
+        bar4 = pci_read_config (dev, func, 0x20);
+        if ((bar4 & 1) == 0 || (bar4 & 0xfffc) == 0)
+          continue;
+
+        /* Enable I/O space access and bus mastering. */
+        pci_write_config (dev, func, 0x04,
+                          (pci_read_config (dev, func, 0x04) & 0xffff)
+                          | 0x05);
+        return bar4 & 0xfffc;
+      }
+  return 0;
+}
+
 /* Resets an ATA channel and waits for any devices present on it
    to finish the reset. */
 static void
@@ -374,7 +723,7 @@ identify_ata_device (struct disk *d)
      indicating the device's response is ready, and read the data
      into our buffer. */
   select_device_wait (d);
-  issue_pio_command (c, CMD_IDENTIFY_DEVICE);
+  issue_command (c, CMD_IDENTIFY_DEVICE);
   sema_down (&c->completion_wait);
   if (!wait_while_busy (d))
     {
@@ -386,6 +735,9 @@ identify_ata_device (struct disk *d)
   /* Calculate capacity. */
   d->capacity = id[60] | ((uint32_t) id[61] << 16);
 
+  /* Use DMA if both the controller and the disk support it. */
+  d->use_dma = c->bm_base != 0 && (id[49] & 0x0100) != 0;
+
   /* Print identification message. */
   printf ("%s: detected %'"PRDSNu" sector (", d->name, d->capacity);
   if (d->capacity > 1024 / DISK_SECTOR_SIZE * 1024 * 1024)
@@ -425,19 +777,152 @@ print_ata_string (char *string, size_t size)
     printf ("%c", string[i ^ 1]);
 }
 
+/* Fills in channel C's PRD table to describe the buffers of the
+   CNT requests in BATCH, which must be in kernel memory and thus
+   physically contiguous. */
+static void
+build_prdt (struct channel *c, struct disk_request **batch, size_t cnt)
+{
+  size_t i, j;
+
+  j = 0;
+  for (i = 0; i < cnt; i++)
+    {
+      uintptr_t addr = vtop (batch[i]->buffer);
+      size_t size = batch[i]->cnt * DISK_SECTOR_SIZE;
+
+      while (size > 0)
+        {
+          size_t region = 0x10000 - (addr & 0xffff);
+          if (region > size)
+            region = size;
+
+          ASSERT (j < PRD_CNT);
+          c->prdt[j].addr = addr;
+          c->prdt[j].size = region & 0xffff;
+          c->prdt[j].flags = 0;
+          j++;
+
+          addr += region;
+          size -= region;
+        }
+    }
+  c->prdt[j - 1].flags = PRD_EOT;
+}
+
+/* Returns the buffer for sector I of the CNT requests in BATCH,
+   counting from the first sector of the first. */
+static uint8_t *
+sector_buffer (struct disk_request **batch, size_t cnt, size_t i)
+{
+  size_t j;
+
+  for (j = 0; j < cnt; j++)
+    {
+      if (i < batch[j]->cnt)
+        return (uint8_t *) batch[j]->buffer + i * DISK_SECTOR_SIZE;
+      i -= batch[j]->cnt;
+    }
+  NOT_REACHED ();
+}
+
+/* Serves the CNT requests in BATCH, which are for consecutive
+   runs of sectors on one disk in one direction, with a single
+   command.  Must be called only by the disk's channel's
+   dispatcher. */
+static void
+transfer (struct disk_request **batch, size_t cnt)
+{
+  struct disk *d = batch[0]->disk;
+  struct channel *c = d->channel;
+  disk_sector_t sec_no = batch[0]->sector;
+  bool read = !batch[0]->write;
+  bool dma = d->use_dma;
+  size_t sectors, i;
+
+  sectors = 0;
+  for (i = 0; i < cnt; i++)
+    {
+      sectors += batch[i]->cnt;
+      if (((uintptr_t) batch[i]->buffer & 1) != 0)
+        dma = false;
+    }
+  ASSERT (sectors > 0 && sectors <= COMMAND_MAX);
+
+  d->command_cnt++;
+  if (read)
+    d->read_cnt += sectors;
+  else
+    d->write_cnt += sectors;
+
+  if (dma)
+    {
+      uint8_t bm_status;
+
+      build_prdt (c, batch, cnt);
+      outl (reg_bm_prdt (c), vtop (c->prdt));
+      outb (reg_bm_command (c), read ? BM_READ : 0);
+      outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+
+      select_sector (d, sec_no, sectors);
+      issue_command (c, read ? CMD_READ_DMA : CMD_WRITE_DMA);
+      outb (reg_bm_command (c), (read ? BM_READ : 0) | BM_START);
+      sema_down (&c->completion_wait);
+      d->interrupt_cnt++;
+
+      outb (reg_bm_command (c), 0);
+      bm_status = inb (reg_bm_status (c));
+      outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+      if ((bm_status & BM_STA_ERR) || (inb (reg_alt_status (c)) & STA_ERR))
+        PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+               read ? "read" : "write", sec_no);
+    }
+  else if (read)
+    {
+      /* The disk interrupts as each sector becomes ready. */
+      select_sector (d, sec_no, sectors);
+      issue_command (c, CMD_READ_SECTOR_RETRY);
+      for (i = 0; i < sectors; i++)
+        {
+          sema_down (&c->completion_wait);
+          d->interrupt_cnt++;
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, sec_no + i);
+          input_sector (c, sector_buffer (batch, cnt, i));
+        }
+    }
+  else
+    {
+      /* The disk interrupts as it accepts each sector. */
+      select_sector (d, sec_no, sectors);
+      issue_command (c, CMD_WRITE_SECTOR_RETRY);
+      for (i = 0; i < sectors; i++)
+        {
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + i);
+          output_sector (c, sector_buffer (batch, cnt, i));
+          sema_down (&c->completion_wait);
+          d->interrupt_cnt++;
+        }
+    }
+}
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT, the number of sectors to transfer, to
+   the disk's sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) 
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) 
 {
   struct channel *c = d->channel;
 
-  ASSERT (sec_no < d->capacity);
-  ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= 256);
+  ASSERT (sec_no < d->capacity && cnt <= d->capacity - sec_no);
+  ASSERT (sec_no + cnt <= (1UL << 28));
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -448,7 +933,7 @@ select_sector (struct disk *d, disk_sector_t sec_no)
 /* Writes COMMAND to channel C and prepares for receiving a
    completion interrupt. */
 static void
-issue_pio_command (struct channel *c, uint8_t command) 
+issue_command (struct channel *c, uint8_t command) 
 {
   /* Interrupts must be enabled or our semaphore will never be
      up'd by the completion handler. */
@@ -2,6 +2,9 @@
 #define DEVICES_DISK_H
 
 #include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* Size of a disk sector in bytes. */
@@ -15,6 +18,30 @@ typedef uint32_t disk_sector_t;
    printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
 
+/* Most sectors in one request. */
+#define DISK_REQUEST_MAX 128
+
+struct disk_request;
+typedef void disk_callback (struct disk_request *);
+
+/* An asynchronous disk request.  The submitter fills in the
+   members up to AUX and passes the request to disk_submit(), then
+   must leave it alone until the callback is called. */
+struct disk_request
+  {
+    struct disk *disk;          /* Disk to access. */
+    disk_sector_t sector;       /* First sector. */
+    size_t cnt;                 /* Sectors, at most DISK_REQUEST_MAX. */
+    void *buffer;               /* CNT * DISK_SECTOR_SIZE bytes. */
+    bool write;                 /* Write BUFFER to disk, or read into it? */
+    void *aux;                  /* For the submitter's use. */
+
+    /* Owned by the disk driver. */
+    disk_callback *callback;    /* Called on completion. */
+    int64_t submit_time;        /* Timer ticks at submission. */
+    struct list_elem elem;      /* Element in channel's queue. */
+  };
+
 void disk_init (void);
 void disk_print_stats (void);
 
@@ -22,5 +49,9 @@ struct disk *disk_get (int chan_no, int dev_no);
 disk_sector_t disk_size (struct disk *);
 void disk_read (struct disk *, disk_sector_t, void *);
 void disk_write (struct disk *, disk_sector_t, const void *);
+void disk_read_multiple (struct disk *, disk_sector_t, size_t cnt, void *);
+void disk_write_multiple (struct disk *, disk_sector_t, size_t cnt,
+                          const void *);
+void disk_submit (struct disk_request *, disk_callback *);
 
 #endif /* devices/disk.h */
@@ -0,0 +1,433 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Buffer cache.  Holds CACHE_SIZE sectors of the file system disk,
+   replaced with the clock algorithm.  Writes are delayed until an
+   entry is evicted, the flusher thread runs, or the file system
+   is shut down.  Entries written as part of an uncommitted
+   transaction (see log.c) are never written back or evicted.
+
+   cache_lock guards which sector each entry holds, the USERS
+   counts, and the clock hand.  Each entry's own lock guards its
+   data, so I/O on one entry does not hold up the others.  An
+   entry is pinned (USERS > 0) by everyone who wants its lock, so
+   an unpinned entry's lock is always free. */
+
+/* A cached sector. */
+struct cache_entry
+  {
+    disk_sector_t sector;               /* Sector held, if IN_USE. */
+    bool in_use;                        /* Holds a sector? */
+    bool valid;                         /* DATA has been read in? */
+    bool dirty;                         /* DATA newer than disk? */
+    bool accessed;                      /* Used since the hand passed? */
+    bool logged;                        /* Held back until committed? */
+    int users;                          /* Pins; see above. */
+    struct lock lock;                   /* Guards DATA. */
+    uint8_t data[DISK_SECTOR_SIZE];     /* Sector contents. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;
+static struct condition cache_unpinned; /* Signaled when USERS drops. */
+static size_t clock_hand;
+
+/* Dirty entries are written back this often. */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ)
+
+/* Write-back requests of a flush in progress, all submitted at
+   once so that the disk's elevator can order and merge them.
+   flush_lock serializes flushes. */
+static struct lock flush_lock;
+static struct disk_request flush_requests[CACHE_SIZE];
+static struct semaphore flush_done;
+
+/* Sectors waiting to be read ahead.  Requests that find the queue
+   full are dropped. */
+#define READAHEAD_MAX 16
+static disk_sector_t readahead_queue[READAHEAD_MAX];
+static size_t readahead_head, readahead_cnt;
+static struct semaphore readahead_sema;
+
+/* Statistics. */
+static long long hit_cnt;               /* Lookups found in cache. */
+static long long miss_cnt;              /* Lookups that went to disk. */
+static long long readahead_cnt_total;   /* Sectors read ahead. */
+
+static struct cache_entry *cache_get (disk_sector_t, bool need_data,
+                                     bool readahead);
+static void cache_put (struct cache_entry *);
+static void write_back (struct cache_entry *);
+static thread_func flusher_thread;
+static thread_func readahead_thread;
+
+/* Initializes the buffer cache and starts its helper threads. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  cond_init (&cache_unpinned);
+  lock_init (&flush_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    lock_init (&cache[i].lock);
+
+  sema_init (&readahead_sema, 0);
+  thread_create ("cache-flush", PRI_DEFAULT, flusher_thread, NULL);
+  thread_create ("read-ahead", PRI_DEFAULT, readahead_thread, NULL);
+}
+
+/* Returns the entry holding SECTOR, or NULL.  Must be called with
+   cache_lock held. */
+static struct cache_entry *
+lookup (disk_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].in_use && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Runs the clock hand over the unpinned entries and returns the
+   first one not accessed since the hand last passed it, or NULL
+   if every entry is pinned.  Must be called with cache_lock
+   held. */
+static struct cache_entry *
+choose_victim (void)
+{
+  size_t i;
+
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+      if (e->users > 0 || e->logged)
+        continue;
+      if (e->in_use && e->accessed)
+        {
+          e->accessed = false;
+          continue;
+        }
+      return e;
+    }
+  return NULL;
+}
+
+/* Returns the entry for SECTOR pinned and locked, reading the
+   sector in if NEED_DATA is true; if NEED_DATA is false the
+   caller is about to overwrite the whole sector.  READAHEAD
+   lookups are left out of the hit rate. */
+static struct cache_entry *
+cache_get (disk_sector_t sector, bool need_data, bool readahead)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      e = lookup (sector);
+      if (e != NULL)
+        {
+          e->users++;
+          if (!readahead)
+            hit_cnt++;
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          break;
+        }
+
+      e = choose_victim ();
+      if (e == NULL)
+        {
+          cond_wait (&cache_unpinned, &cache_lock);
+          continue;
+        }
+
+      if (e->in_use && e->valid && e->dirty)
+        {
+          /* Write the victim back before taking it over.  It keeps
+             its old sector meanwhile, so that lookups of that
+             sector wait for the write instead of reading what is
+             on disk.  Then look again: SECTOR may have come in,
+             or the victim been used, while the lock was down. */
+          e->users++;
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          write_back (e);
+          lock_release (&e->lock);
+          lock_acquire (&cache_lock);
+          e->users--;
+          cond_signal (&cache_unpinned, &cache_lock);
+          continue;
+        }
+
+      /* Take over clean E for SECTOR.  It was unpinned, so its
+         lock is free.  Lookups of SECTOR from now on wait on the
+         lock until the data is in. */
+      e->users++;
+      if (!readahead)
+        miss_cnt++;
+      lock_acquire (&e->lock);
+      e->sector = sector;
+      e->in_use = true;
+      e->valid = false;
+      e->dirty = false;
+      e->logged = false;
+      lock_release (&cache_lock);
+
+      if (readahead)
+        readahead_cnt_total++;
+      break;
+    }
+
+  if (!e->valid && need_data)
+    {
+      disk_read (filesys_disk, sector, e->data);
+      e->valid = true;
+    }
+  e->accessed = true;
+  return e;
+}
+
+/* Unlocks and unpins E. */
+static void
+cache_put (struct cache_entry *e)
+{
+  lock_release (&e->lock);
+
+  lock_acquire (&cache_lock);
+  e->users--;
+  cond_signal (&cache_unpinned, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Copies SIZE bytes starting at byte OFS of SECTOR into BUFFER. */
+void
+cache_read (disk_sector_t sector, void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+  e = cache_get (sector, true, false);
+  memcpy (buffer, e->data + ofs, size);
+  cache_put (e);
+}
+
+/* Copies SIZE bytes from BUFFER into SECTOR starting at byte OFS,
+   and holds SECTOR back from the disk until cache_unlog() if
+   LOGGED. */
+static void
+write (disk_sector_t sector, const void *buffer, int ofs, int size,
+       bool logged)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+  e = cache_get (sector, size < DISK_SECTOR_SIZE, false);
+  memcpy (e->data + ofs, buffer, size);
+  e->valid = true;
+  e->dirty = true;
+  if (logged)
+    e->logged = true;
+  cache_put (e);
+}
+
+/* Copies SIZE bytes from BUFFER into SECTOR starting at byte OFS.
+   The write reaches the disk later. */
+void
+cache_write (disk_sector_t sector, const void *buffer, int ofs, int size)
+{
+  write (sector, buffer, ofs, size, false);
+}
+
+/* Like cache_write(), but for a sector in an uncommitted
+   transaction: SECTOR stays in the cache and off the disk until
+   cache_unlog() is called for it. */
+void
+cache_write_logged (disk_sector_t sector, const void *buffer, int ofs,
+                    int size)
+{
+  write (sector, buffer, ofs, size, true);
+}
+
+/* Lets SECTOR, whose transaction has committed, be written back
+   and evicted like any other. */
+void
+cache_unlog (disk_sector_t sector)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = lookup (sector);
+  if (e != NULL)
+    e->logged = false;
+  lock_release (&cache_lock);
+}
+
+/* Asks for SECTOR to be read into the cache in the background. */
+void
+cache_readahead (disk_sector_t sector)
+{
+  bool queued = false;
+
+  lock_acquire (&cache_lock);
+  if (readahead_cnt < READAHEAD_MAX)
+    {
+      readahead_queue[(readahead_head + readahead_cnt) % READAHEAD_MAX]
+        = sector;
+      readahead_cnt++;
+      queued = true;
+    }
+  lock_release (&cache_lock);
+
+  if (queued)
+    sema_up (&readahead_sema);
+}
+
+/* Writes E back to disk if it is dirty and not held back.  Must be
+   called with E's lock held. */
+static void
+write_back (struct cache_entry *e)
+{
+  if (e->in_use && e->valid && e->dirty && !e->logged)
+    {
+      disk_write (filesys_disk, e->sector, e->data);
+      e->dirty = false;
+    }
+}
+
+/* Called when a write-back request submitted by cache_flush()
+   completes. */
+static void
+flush_complete (struct disk_request *r UNUSED)
+{
+  sema_up (&flush_done);
+}
+
+/* Writes every dirty entry back to disk. */
+void
+cache_flush (void)
+{
+  struct cache_entry *flushed[CACHE_SIZE];
+  size_t cnt = 0;
+  size_t i;
+
+  lock_acquire (&flush_lock);
+  sema_init (&flush_done, 0);
+
+  /* Lock the entries to write back, and leave the others. */
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      lock_acquire (&cache_lock);
+      e->users++;
+      lock_release (&cache_lock);
+
+      lock_acquire (&e->lock);
+      if (e->in_use && e->valid && e->dirty && !e->logged)
+        flushed[cnt++] = e;
+      else
+        cache_put (e);
+    }
+
+  /* Write them back together. */
+  for (i = 0; i < cnt; i++)
+    {
+      struct disk_request *r = &flush_requests[i];
+
+      r->disk = filesys_disk;
+      r->sector = flushed[i]->sector;
+      r->cnt = 1;
+      r->buffer = flushed[i]->data;
+      r->write = true;
+      r->aux = NULL;
+      disk_submit (r, flush_complete);
+    }
+  for (i = 0; i < cnt; i++)
+    sema_down (&flush_done);
+
+  for (i = 0; i < cnt; i++)
+    {
+      flushed[i]->dirty = false;
+      cache_put (flushed[i]);
+    }
+  lock_release (&flush_lock);
+}
+
+/* Writes SECTOR back to disk now if it is cached and dirty. */
+void
+cache_flush_sector (disk_sector_t sector)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = lookup (sector);
+  if (e == NULL)
+    {
+      lock_release (&cache_lock);
+      return;
+    }
+  e->users++;
+  lock_release (&cache_lock);
+
+  lock_acquire (&e->lock);
+  if (e->sector == sector)
+    write_back (e);
+  cache_put (e);
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  long long lookups = hit_cnt + miss_cnt;
+
+  printf ("Buffer cache: %lld hits, %lld misses (%lld%% hit rate), "
+          "%lld sectors read ahead\n", hit_cnt, miss_cnt,
+          lookups > 0 ? hit_cnt * 100 / lookups : 0, readahead_cnt_total);
+}
+
+/* Writes dirty entries back every FLUSH_INTERVAL ticks, to bound
+   what a crash can lose. */
+static void
+flusher_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (FLUSH_INTERVAL);
+      cache_flush ();
+    }
+}
+
+/* Reads queued sectors into the cache. */
+static void
+readahead_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      disk_sector_t sector;
+
+      sema_down (&readahead_sema);
+
+      lock_acquire (&cache_lock);
+      sector = readahead_queue[readahead_head];
+      readahead_head = (readahead_head + 1) % READAHEAD_MAX;
+      readahead_cnt--;
+      lock_release (&cache_lock);
+
+      cache_put (cache_get (sector, true, true));
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include "devices/disk.h"
+
+/* Number of sectors held in the buffer cache. */
+#define CACHE_SIZE 64
+
+void cache_init (void);
+void cache_read (disk_sector_t, void *, int ofs, int size);
+void cache_write (disk_sector_t, const void *, int ofs, int size);
+void cache_write_logged (disk_sector_t, const void *, int ofs, int size);
+void cache_unlog (disk_sector_t);
+void cache_readahead (disk_sector_t);
+void cache_flush (void);
+void cache_flush_sector (disk_sector_t);
+void cache_print_stats (void);
+
+#endif /* filesys/cache.h */
@@ -0,0 +1,216 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.  Maps a directory's inode sector and a
+   name in it to the inode sector the name refers to, or records
+   that the name is absent, so that resolving a path does not
+   search each directory along it.  Holds at most DCACHE_SIZE
+   entries and replaces the least recently used.
+
+   The directory code keeps the cache coherent: adding or
+   removing a name replaces whatever was cached for it, and
+   removing a directory forgets everything cached under it. */
+
+/* A cached name. */
+struct dcache_entry
+  {
+    disk_sector_t parent;               /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Name within PARENT. */
+    bool negative;                      /* Known to be absent? */
+    disk_sector_t child;                /* Inode sector, if not NEGATIVE. */
+    bool in_use;                        /* In TABLE? */
+    struct hash_elem hash_elem;         /* Element in TABLE. */
+    struct list_elem lru_elem;          /* Element in LRU. */
+  };
+
+static struct dcache_entry entries[DCACHE_SIZE];
+static struct hash table;               /* Entries in use. */
+static struct list lru;                 /* All entries, most recent first. */
+static struct lock dcache_lock;         /* Guards the above. */
+
+/* Statistics. */
+static long long hit_cnt;               /* Lookups that found a name. */
+static long long negative_cnt;          /* Lookups that found an absence. */
+static long long miss_cnt;              /* Lookups not cached. */
+
+static hash_hash_func entry_hash;
+static hash_less_func entry_less;
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void)
+{
+  size_t i;
+
+  hash_init (&table, entry_hash, entry_less, NULL);
+  list_init (&lru);
+  lock_init (&dcache_lock);
+  for (i = 0; i < DCACHE_SIZE; i++)
+    list_push_back (&lru, &entries[i].lru_elem);
+}
+
+/* Returns the entry for NAME in PARENT, or NULL.  Must be called
+   with dcache_lock held. */
+static struct dcache_entry *
+find (disk_sector_t parent, const char *name)
+{
+  struct dcache_entry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.parent = parent;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&table, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dcache_entry, hash_elem) : NULL;
+}
+
+/* Drops entry E from the table and makes it the first to be
+   reused.  Must be called with dcache_lock held. */
+static void
+drop (struct dcache_entry *e)
+{
+  hash_delete (&table, &e->hash_elem);
+  e->in_use = false;
+  list_remove (&e->lru_elem);
+  list_push_back (&lru, &e->lru_elem);
+}
+
+/* Looks up NAME in the directory whose inode is in sector PARENT.
+   On DCACHE_HIT, stores the inode sector NAME refers to in
+   *CHILD. */
+enum dcache_result
+dcache_lookup (disk_sector_t parent, const char *name, disk_sector_t *child)
+{
+  struct dcache_entry *e;
+  enum dcache_result result;
+
+  lock_acquire (&dcache_lock);
+  e = find (parent, name);
+  if (e == NULL)
+    {
+      miss_cnt++;
+      result = DCACHE_MISS;
+    }
+  else
+    {
+      list_remove (&e->lru_elem);
+      list_push_front (&lru, &e->lru_elem);
+      if (e->negative)
+        {
+          negative_cnt++;
+          result = DCACHE_NEGATIVE;
+        }
+      else
+        {
+          hit_cnt++;
+          *child = e->child;
+          result = DCACHE_HIT;
+        }
+    }
+  lock_release (&dcache_lock);
+  return result;
+}
+
+/* Records NAME in PARENT as referring to CHILD, or as absent if
+   NEGATIVE, replacing any entry already cached for it. */
+static void
+insert (disk_sector_t parent, const char *name, bool negative,
+        disk_sector_t child)
+{
+  struct dcache_entry *e;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  e = find (parent, name);
+  if (e == NULL)
+    {
+      e = list_entry (list_back (&lru), struct dcache_entry, lru_elem);
+      if (e->in_use)
+        hash_delete (&table, &e->hash_elem);
+      e->parent = parent;
+      strlcpy (e->name, name, sizeof e->name);
+      e->in_use = true;
+      hash_insert (&table, &e->hash_elem);
+    }
+  e->negative = negative;
+  e->child = child;
+  list_remove (&e->lru_elem);
+  list_push_front (&lru, &e->lru_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Records that NAME in the directory whose inode is in sector
+   PARENT refers to the inode in sector CHILD. */
+void
+dcache_insert (disk_sector_t parent, const char *name, disk_sector_t child)
+{
+  insert (parent, name, false, child);
+}
+
+/* Records that there is no NAME in the directory whose inode is
+   in sector PARENT. */
+void
+dcache_insert_negative (disk_sector_t parent, const char *name)
+{
+  insert (parent, name, true, 0);
+}
+
+/* Forgets every name cached under the directory whose inode is in
+   sector DIR, which is being removed and whose sector may be
+   reused. */
+void
+dcache_forget_dir (disk_sector_t dir)
+{
+  size_t i;
+
+  lock_acquire (&dcache_lock);
+  for (i = 0; i < DCACHE_SIZE; i++)
+    if (entries[i].in_use && entries[i].parent == dir)
+      drop (&entries[i]);
+  lock_release (&dcache_lock);
+}
+
+/* Prints directory entry cache statistics. */
+void
+dcache_print_stats (void)
+{
+  long long lookups = hit_cnt + negative_cnt + miss_cnt;
+
+  printf ("Dentry cache: %lld hits, %lld negative hits, %lld misses "
+          "(%lld%% hit rate)\n", hit_cnt, negative_cnt, miss_cnt,
+          lookups > 0 ? (hit_cnt + negative_cnt) * 100 / lookups : 0);
+}
+
+/* Returns a hash of entry E's directory and name. */
+static unsigned
+entry_hash (const struct hash_elem *e_, void *aux UNUSED)
+{
+  const struct dcache_entry *e = hash_entry (e_, struct dcache_entry,
+                                             hash_elem);
+
+  return hash_string (e->name) ^ hash_int (e->parent);
+}
+
+/* Returns true if entry A precedes entry B. */
+static bool
+entry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct dcache_entry *a = hash_entry (a_, struct dcache_entry,
+                                             hash_elem);
+  const struct dcache_entry *b = hash_entry (b_, struct dcache_entry,
+                                             hash_elem);
+
+  if (a->parent != b->parent)
+    return a->parent < b->parent;
+  return strcmp (a->name, b->name) < 0;
+}
@@ -0,0 +1,27 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+/* Maximum number of cached directory entries. */
+#define DCACHE_SIZE 256
+
+/* Result of a directory entry cache lookup. */
+enum dcache_result
+  {
+    DCACHE_MISS,                /* Not cached; search the directory. */
+    DCACHE_HIT,                 /* Name is present. */
+    DCACHE_NEGATIVE             /* Name is known to be absent. */
+  };
+
+void dcache_init (void);
+enum dcache_result dcache_lookup (disk_sector_t parent, const char *name,
+                                  disk_sector_t *child);
+void dcache_insert (disk_sector_t parent, const char *name,
+                    disk_sector_t child);
+void dcache_insert_negative (disk_sector_t parent, const char *name);
+void dcache_forget_dir (disk_sector_t dir);
+void dcache_print_stats (void);
+
+#endif /* filesys/dcache.h */
@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <hash.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -21,12 +24,88 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* A directory is an array of sector-sized blocks of entries.
+
+   A small directory is searched block by block.  Once it would
+   grow past HASH_MIN_BLOCKS blocks, it is rebuilt as a hash
+   table: block I is the bucket for names that hash to I modulo
+   the bucket count recorded in block 0, and a full bucket chains
+   to overflow blocks appended at the end of the directory.  A
+   chain that grows past MAX_CHAIN blocks makes the table double
+   in size, so a lookup reads a bounded number of blocks however
+   many entries there are.  A bucket's block is found by
+   arithmetic, so the only part of the bucket directory to keep
+   at hand is the count, which the buffer cache holds. */
+#define DIR_BLOCK_ENTRIES 25
+#define HASH_MIN_BLOCKS 4
+#define MAX_CHAIN 2
+
+struct dir_block
+  {
+    struct dir_entry entries[DIR_BLOCK_ENTRIES];
+    uint32_t next;                      /* Overflow block, or 0 if none. */
+    uint32_t bucket_cnt;                /* Block 0 only: 0 if not hashed. */
+    uint32_t unused;                    /* Not used. */
+  };
+
+/* Returns the byte offset of entry I of block IDX. */
+static off_t
+entry_ofs (size_t idx, size_t i)
+{
+  return idx * DISK_SECTOR_SIZE + i * sizeof (struct dir_entry);
+}
+
+/* Returns the number of blocks in DIR. */
+static size_t
+block_cnt (const struct dir *dir)
+{
+  return inode_length (dir->inode) / DISK_SECTOR_SIZE;
+}
+
+/* Returns DIR's bucket count, or 0 if DIR is not hashed. */
+static uint32_t
+bucket_cnt (const struct dir *dir)
+{
+  uint32_t cnt;
+
+  if (inode_read_at (dir->inode, &cnt, sizeof cnt,
+                     offsetof (struct dir_block, bucket_cnt)) != sizeof cnt)
+    return 0;
+  return cnt;
+}
+
+/* Returns the bucket for NAME in a table of BUCKETS buckets. */
+static size_t
+bucket_of (const char *name, uint32_t buckets)
+{
+  return hash_string (name) % buckets;
+}
+
+/* Reads block IDX of DIR into B.  Returns true if successful. */
+static bool
+read_block (const struct dir *dir, size_t idx, struct dir_block *b)
+{
+  return inode_read_at (dir->inode, b, sizeof *b,
+                        idx * DISK_SECTOR_SIZE) == sizeof *b;
+}
+
+/* Writes B as block IDX of DIR.  Returns true if successful. */
+static bool
+write_block (struct dir *dir, size_t idx, const struct dir_block *b)
+{
+  return inode_write_at (dir->inode, b, sizeof *b,
+                         idx * DISK_SECTOR_SIZE) == sizeof *b;
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (disk_sector_t sector, size_t entry_cnt) 
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  ASSERT (sizeof (struct dir_block) == DISK_SECTOR_SIZE);
+
+  return inode_create (sector, DIV_ROUND_UP (entry_cnt, DIR_BLOCK_ENTRIES)
+                               * DISK_SECTOR_SIZE);
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -38,6 +117,7 @@ dir_open (struct inode *inode)
 
   if (inode != NULL && dir != NULL)
     {
+      inode_set_metadata (inode);
       dir->inode = inode;
       dir->pos = 0;
       return dir;
@@ -93,23 +173,166 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
-  struct dir_entry e;
-  size_t ofs;
+  struct dir_block *b;
+  uint32_t buckets;
+  size_t idx, i;
+  bool found = false;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+
+  /* Search NAME's hash chain, or every block if not hashed. */
+  buckets = bucket_cnt (dir);
+  idx = buckets > 0 ? bucket_of (name, buckets) : 0;
+  while (!found && read_block (dir, idx, b))
+    {
+      for (i = 0; i < DIR_BLOCK_ENTRIES; i++)
+        if (b->entries[i].in_use && !strcmp (name, b->entries[i].name))
+          {
+            if (ep != NULL)
+              *ep = b->entries[i];
+            if (ofsp != NULL)
+              *ofsp = entry_ofs (idx, i);
+            found = true;
+            break;
+          }
+
+      if (buckets == 0)
+        idx++;
+      else if (b->next != 0)
+        idx = b->next;
+      else
+        break;
+    }
+  free (b);
+  return found;
+}
+
+/* Adds E to the chain of its bucket in hashed directory DIR of
+   BUCKETS buckets, using B as a scratch block.  Appends an
+   overflow block if the chain is full, unless the chain already
+   has MAX_CHAIN blocks and LIMIT is true.  Returns true if
+   successful. */
+static bool
+bucket_insert (struct dir *dir, uint32_t buckets, const struct dir_entry *e,
+             struct dir_block *b, bool limit)
+{
+  size_t idx = bucket_of (e->name, buckets);
+  size_t chain = 1;
+  size_t i, new_idx;
+
+  for (;;)
+    {
+      if (!read_block (dir, idx, b))
+        return false;
+      for (i = 0; i < DIR_BLOCK_ENTRIES; i++)
+        if (!b->entries[i].in_use)
+          return inode_write_at (dir->inode, e, sizeof *e, entry_ofs (idx, i))
+                 == sizeof *e;
+      if (b->next == 0)
+        break;
+      idx = b->next;
+      chain++;
+    }
+  if (limit && chain >= MAX_CHAIN)
+    return false;
+
+  /* Link a new overflow block to the end of the chain. */
+  new_idx = block_cnt (dir);
+  b->next = new_idx;
+  if (!write_block (dir, idx, b))
+    return false;
+  memset (b, 0, sizeof *b);
+  b->entries[0] = *e;
+  return write_block (dir, new_idx, b);
+}
+
+/* Rebuilds DIR as a hash table of at least BUCKETS buckets,
+   using B as a scratch block.  Every existing block becomes a
+   bucket, so none is wasted.  Returns true if successful.
+
+   The new table is laid out in memory and DIR grown to its size
+   before any block in use is overwritten, so that running out of
+   space leaves DIR as it was. */
+static bool
+rehash (struct dir *dir, uint32_t buckets, struct dir_block *b)
+{
+  size_t blocks = block_cnt (dir);
+  struct dir_entry *entries;
+  struct dir_block *table;
+  size_t cnt = 0, table_cnt;
+  size_t idx, i, j;
+  bool success;
+
+  if (buckets < blocks)
+    buckets = blocks;
+
+  /* Gather the entries in use. */
+  entries = malloc (blocks * DIR_BLOCK_ENTRIES * sizeof *entries);
+  if (entries == NULL)
+    return false;
+  for (idx = 0; idx < blocks; idx++)
+    {
+      if (!read_block (dir, idx, b))
+        {
+          free (entries);
+          return false;
+        }
+      for (i = 0; i < DIR_BLOCK_ENTRIES; i++)
+        if (b->entries[i].in_use)
+          entries[cnt++] = b->entries[i];
+    }
+
+  /* Put them into empty buckets.  A chain of N blocks holds more
+     than N - 1 blocks' worth of entries, which bounds the number
+     of overflow blocks. */
+  table = calloc (buckets + cnt / DIR_BLOCK_ENTRIES, sizeof *table);
+  if (table == NULL)
+    {
+      free (entries);
+      return false;
+    }
+  table[0].bucket_cnt = buckets;
+  table_cnt = buckets;
+  for (i = 0; i < cnt; i++)
+    {
+      idx = bucket_of (entries[i].name, buckets);
+      for (;;)
+        {
+          for (j = 0; j < DIR_BLOCK_ENTRIES; j++)
+            if (!table[idx].entries[j].in_use)
+              break;
+          if (j < DIR_BLOCK_ENTRIES)
+            break;
+          if (table[idx].next == 0)
+            {
+              table[idx].next = table_cnt;
+              idx = table_cnt++;
+              j = 0;
+              break;
+            }
+          idx = table[idx].next;
+        }
+      table[idx].entries[j] = entries[i];
+    }
+  free (entries);
+
+  /* Grow DIR with empty blocks, which are harmless if left over.
+     Then write the table, block 0 last, since it switches DIR
+     over. */
+  memset (b, 0, sizeof *b);
+  success = true;
+  for (idx = blocks; idx < table_cnt && success; idx++)
+    success = write_block (dir, idx, b);
+  for (idx = table_cnt; idx-- > 0 && success; )
+    success = write_block (dir, idx, &table[idx]);
+
+  free (table);
+  return success;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -120,15 +343,37 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  disk_sector_t parent = inode_get_inumber (dir->inode);
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  inode_lock (dir->inode);
+  switch (dcache_lookup (parent, name, &e.inode_sector))
+    {
+    case DCACHE_HIT:
+      *inode = inode_open (e.inode_sector);
+      break;
+
+    case DCACHE_NEGATIVE:
+      *inode = NULL;
+      break;
+
+    default:
+      if (lookup (dir, name, &e, NULL))
+        {
+          dcache_insert (parent, name, e.inode_sector);
+          *inode = inode_open (e.inode_sector);
+        }
+      else
+        {
+          dcache_insert_negative (parent, name);
+          *inode = NULL;
+        }
+      break;
+    }
+  inode_unlock (dir->inode);
 
   return *inode != NULL;
 }
@@ -143,7 +388,8 @@ bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) 
 {
   struct dir_entry e;
-  off_t ofs;
+  struct dir_block *b = NULL;
+  uint32_t buckets;
   bool success = false;
   
   ASSERT (dir != NULL);
@@ -154,28 +400,63 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector)
     return false;
 
   /* Check that NAME is not in use. */
+  inode_lock (dir->inode);
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    goto done;
+
+  buckets = bucket_cnt (dir);
+  if (buckets == 0)
+    {
+      /* Take the first free slot, or append a block. */
+      size_t blocks = block_cnt (dir);
+      size_t idx, i;
+
+      for (idx = 0; idx < blocks; idx++)
+        {
+          if (!read_block (dir, idx, b))
+            goto done;
+          for (i = 0; i < DIR_BLOCK_ENTRIES; i++)
+            if (!b->entries[i].in_use)
+              {
+                success = inode_write_at (dir->inode, &e, sizeof e,
+                                          entry_ofs (idx, i)) == sizeof e;
+                goto done;
+              }
+        }
+
+      if (blocks < HASH_MIN_BLOCKS)
+        {
+          memset (b, 0, sizeof *b);
+          b->entries[0] = e;
+          success = write_block (dir, blocks, b);
+          goto done;
+        }
+
+      /* Too big to search linearly: switch to a hash table. */
+      buckets = 2 * HASH_MIN_BLOCKS;
+      if (!rehash (dir, buckets, b))
+        goto done;
+      buckets = bucket_cnt (dir);
+    }
+
+  success = bucket_insert (dir, buckets, &e, b, true);
+  if (!success && rehash (dir, 2 * buckets, b))
+    success = bucket_insert (dir, bucket_cnt (dir), &e, b, false);
 
  done:
+  /* Replaces any negative entry cached for NAME. */
+  if (success)
+    dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
+  inode_unlock (dir->inode);
+  free (b);
   return success;
 }
 
@@ -194,6 +475,7 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (name != NULL);
 
   /* Find directory entry. */
+  inode_lock (dir->inode);
   if (!lookup (dir, name, &e, &ofs))
     goto done;
 
@@ -207,11 +489,15 @@ dir_remove (struct dir *dir, const char *name)
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
 
-  /* Remove inode. */
+  /* Remove inode, and whatever was cached under it in case it is
+     a directory. */
+  dcache_insert_negative (inode_get_inumber (dir->inode), name);
+  dcache_forget_dir (e.inode_sector);
   inode_remove (inode);
   success = true;
 
  done:
+  inode_unlock (dir->inode);
   inode_close (inode);
   return success;
 }
@@ -223,15 +509,26 @@ bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool found = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  inode_lock (dir->inode);
+  for (;;)
     {
+      /* Skip the link and count at the end of each block. */
+      if (dir->pos % DISK_SECTOR_SIZE
+          > (off_t) entry_ofs (0, DIR_BLOCK_ENTRIES - 1))
+        dir->pos = ROUND_UP (dir->pos, DISK_SECTOR_SIZE);
+      if (inode_read_at (dir->inode, &e, sizeof e, dir->pos) != sizeof e)
+        break;
+
       dir->pos += sizeof e;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          found = true;
+          break;
         } 
     }
-  return false;
+  inode_unlock (dir->inode);
+  return found;
 }
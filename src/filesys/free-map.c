@@ -1,12 +1,81 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include <stdio.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/log.h"
+#include "threads/synch.h"
+
+/* The free map is kept in memory and written back lazily.  Each
+   change marks the sector of the free map file that holds the
+   changed bits, and free_map_flush() writes only marked sectors.
+   Each transaction commit (see log.c) flushes the map into the
+   transaction, so a block allocated to an inode is marked in use
+   on disk by the same commit that makes the inode point to it.
+
+   A released sector is held back from allocation until the next
+   checkpoint, since the log may still hold an image of it that
+   replay would write over its new contents. */
+
+#define BITS_PER_SECTOR (DISK_SECTOR_SIZE * 8)
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static struct bitmap *dirty_map;     /* Free map file sectors to write. */
+static struct bitmap *held_map;      /* Released since HELD_EPOCH. */
+static long long held_epoch;         /* Checkpoint count HELD_MAP dates from. */
+static struct lock free_map_lock;    /* Guards the above. */
+static disk_sector_t next_hint;      /* Sector after the last allocation. */
+
+/* Statistics. */
+static long long flush_cnt;          /* Flushes that wrote something. */
+static long long sector_write_cnt;   /* Free map file sectors written. */
+
+/* Marks the free map file sectors holding the bits for CNT
+   sectors starting at SECTOR as needing to be written. */
+static void
+mark_dirty (disk_sector_t sector, size_t cnt)
+{
+  size_t first = sector / BITS_PER_SECTOR;
+  size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+
+  bitmap_set_multiple (dirty_map, first, last - first + 1, true);
+}
+
+/* Stops holding back released sectors if there has been a
+   checkpoint since they were released.  Must be called with
+   free_map_lock held. */
+static void
+update_held (void)
+{
+  long long epoch = log_checkpoint_cnt ();
+
+  if (epoch != held_epoch)
+    {
+      bitmap_set_all (held_map, false);
+      held_epoch = epoch;
+    }
+}
+
+/* Returns the first run of CNT sectors at or after START that are
+   free and not held back, or BITMAP_ERROR if there is none.  Must
+   be called with free_map_lock held. */
+static disk_sector_t
+scan (disk_sector_t start, size_t cnt)
+{
+  while (start < bitmap_size (free_map))
+    {
+      disk_sector_t sector = bitmap_scan (free_map, start, cnt, false);
+
+      if (sector == BITMAP_ERROR || bitmap_none (held_map, sector, cnt))
+        return sector;
+      start = sector + 1;
+    }
+  return BITMAP_ERROR;
+}
 
 /* Initializes the free map. */
 void
@@ -15,27 +84,66 @@ free_map_init (void)
   free_map = bitmap_create (disk_size (filesys_disk));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--disk is too large");
+  dirty_map = bitmap_create (DIV_ROUND_UP (bitmap_size (free_map),
+                                           BITS_PER_SECTOR));
+  if (dirty_map == NULL)
+    PANIC ("bitmap creation failed--disk is too large");
+  held_map = bitmap_create (bitmap_size (free_map));
+  if (held_map == NULL)
+    PANIC ("bitmap creation failed--disk is too large");
+  lock_init (&free_map_lock);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, LOG_SECTOR, LOG_SECTORS, true);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  Allocation continues from where the
+   last one ended, so that data written together lands together.
    Returns true if successful, false if all sectors were
    available. */
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) 
 {
-  disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  return free_map_allocate_near (cnt, next_hint, sectorp);
+}
+
+/* Allocates CNT consecutive sectors from the free map, taking the
+   first free run at or after HINT and wrapping around to the
+   start of the disk if there is none, and stores the first into
+   *SECTORP.  Passing the sector just past a file's last block
+   extends that file's run in place when the sector is free.
+   If only held-back sectors would do, forces a checkpoint to free
+   them.  Returns true if successful, false if no run of CNT free
+   sectors exists. */
+bool
+free_map_allocate_near (size_t cnt, disk_sector_t hint,
+                        disk_sector_t *sectorp)
+{
+  disk_sector_t sector = BITMAP_ERROR;
+  bool forced = false;
+
+  lock_acquire (&free_map_lock);
+  for (;;)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      update_held ();
+      sector = scan (hint, cnt);
+      if (sector == BITMAP_ERROR)
+        sector = scan (0, cnt);
+      if (sector != BITMAP_ERROR || forced
+          || bitmap_none (held_map, 0, bitmap_size (held_map)))
+        break;
+      log_force_checkpoint ();
+      forced = true;
     }
   if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+    {
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      mark_dirty (sector, cnt);
+      *sectorp = sector;
+      next_hint = sector + cnt;
+    }
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
@@ -43,9 +151,42 @@ free_map_allocate (size_t cnt, disk_sector_t *sectorp)
 void
 free_map_release (disk_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  mark_dirty (sector, cnt);
+  update_held ();
+  bitmap_set_multiple (held_map, sector, cnt, true);
+  lock_release (&free_map_lock);
+}
+
+/* Writes the changed parts of the free map to the free map file,
+   as part of the calling thread's transaction if it is in one.
+   Does nothing if the free map file is not open. */
+void
+free_map_flush (void)
+{
+  size_t i;
+  bool wrote = false;
+
+  if (free_map_file == NULL)
+    return;
+
+  lock_acquire (&free_map_lock);
+  for (i = 0; i < bitmap_size (dirty_map); i++)
+    if (bitmap_test (dirty_map, i))
+      {
+        off_t ofs = i * DISK_SECTOR_SIZE;
+
+        bitmap_reset (dirty_map, i);
+        if (!bitmap_write_at (free_map, free_map_file, ofs, DISK_SECTOR_SIZE))
+          PANIC ("can't write free map");
+        sector_write_cnt++;
+        wrote = true;
+      }
+  if (wrote)
+    flush_cnt++;
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -57,13 +198,16 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  inode_set_metadata (file_get_inode (free_map_file));
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+  free_map_flush ();
   file_close (free_map_file);
+  free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -81,4 +225,13 @@ free_map_create (void)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  bitmap_set_all (dirty_map, false);
+}
+
+/* Prints free map statistics. */
+void
+free_map_print_stats (void)
+{
+  printf ("Free map: %lld sectors written in %lld flushes\n",
+          sector_write_cnt, flush_cnt);
 }
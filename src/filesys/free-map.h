@@ -10,8 +10,11 @@ void free_map_read (void);
 void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
+void free_map_flush (void);
+void free_map_print_stats (void);
 
 bool free_map_allocate (size_t, disk_sector_t *);
+bool free_map_allocate_near (size_t, disk_sector_t, disk_sector_t *);
 void free_map_release (disk_sector_t, size_t);
 
 #endif /* filesys/free-map.h */
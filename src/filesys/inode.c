@@ -1,23 +1,71 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/log.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Block index geometry.  Data block I of a file is found in
+   DIRECT[I] for the first DIRECT_CNT blocks, then through the
+   indirect block, then through the doubly indirect block, so a
+   lookup takes at most two index block reads. */
+#define DIRECT_CNT 122
+#define PTRS_PER_SECTOR (DISK_SECTOR_SIZE / sizeof (disk_sector_t))
+#define MAX_BLOCKS (DIRECT_CNT + PTRS_PER_SECTOR \
+                    + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+
+/* Largest file size, a little over 8 MB. */
+#define INODE_MAX_LENGTH ((off_t) (MAX_BLOCKS * DISK_SECTOR_SIZE))
+
+/* Index entry of a block that is not allocated.  Sector 0 holds
+   the free map inode, so it is never a data or index block.
+   Unallocated data blocks are holes that read as zeros. */
+#define NO_SECTOR 0
+
+/* A file's blocks are allocated when it is created but not
+   zeroed.  Instead the inode records how many leading blocks have
+   been initialized, and blocks at or past that watermark read as
+   zeros whatever they hold on disk.  Writing past the watermark
+   zeroes any allocated blocks it skips over and moves it, so a
+   file written from the start never has its blocks zeroed at
+   all. */
+
+/* A file of at most INLINE_MAX bytes keeps its data in the inode
+   sector, in place of the block index, so reading it takes no
+   sector beyond the inode's and creating it allocates nothing
+   more.  Growing it past INLINE_MAX moves the data out to a block
+   of its own.  Files never shrink, so a file never moves back. */
+#define INLINE_MAX ((DIRECT_CNT + 2) * sizeof (disk_sector_t))
+
 /* On-disk inode.
    Must be exactly DISK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
-    disk_sector_t start;                /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint16_t extent_cnt;                /* Contiguous runs of data blocks. */
+    uint16_t is_inline;                 /* Data in INLINE_DATA? */
+    uint32_t initialized;               /* Blocks before this one hold data. */
+    union
+      {
+        struct
+          {
+            disk_sector_t direct[DIRECT_CNT];   /* Direct data blocks. */
+            disk_sector_t indirect;     /* Indirect index block. */
+            disk_sector_t doubly_indirect; /* Doubly indirect index block. */
+          };
+        uint8_t inline_data[INLINE_MAX]; /* Data, if IS_INLINE. */
+      };
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,40 +76,355 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* In-memory inode.
+
+   Locking: inodes_lock guards the inode table, the closed list
+   and every OPEN_CNT.  Each inode's LOCK guards its REMOVED and
+   DENY_WRITE_CNT and its DATA, including the index blocks, but
+   is not held while file data is copied to or from the buffer
+   cache, so readers and writers of one file overlap their I/O
+   and those of different files never wait for each other.
+   DIR_LOCK is for callers; directories hold it across each
+   operation.
+
+   Lock order: starting a transaction (log_begin()), then DIR_LOCK,
+   then LOCK or inodes_lock, then the free map lock, then the
+   buffer cache's locks.  The free map's own
+   file is the exception: it is written with the free map lock
+   held, which is safe because it never allocates. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem hash_elem;         /* Element in inode table. */
+    struct list_elem elem;              /* Element in closed list. */
     disk_sector_t sector;               /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct lock lock;                   /* Guards the inode; see above. */
+    struct lock dir_lock;               /* Held by directory operations. */
+    bool metadata;                      /* Is the data logged? */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Returns entry I of index block BLOCK, or NO_SECTOR if BLOCK is
+   itself NO_SECTOR. */
+static disk_sector_t
+read_ptr (disk_sector_t block, size_t i)
+{
+  disk_sector_t sector;
+
+  if (block == NO_SECTOR)
+    return NO_SECTOR;
+  cache_read (block, &sector, i * sizeof sector, sizeof sector);
+  return sector;
+}
+
+/* Returns the sector of data block IDX of DISK_INODE, or NO_SECTOR
+   if that block is a hole. */
+static disk_sector_t
+index_lookup (const struct inode_disk *disk_inode, size_t idx)
+{
+  if (idx < DIRECT_CNT)
+    return disk_inode->direct[idx];
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    return read_ptr (disk_inode->indirect, idx);
+  idx -= PTRS_PER_SECTOR;
+
+  if (idx < PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+    return read_ptr (read_ptr (disk_inode->doubly_indirect,
+                               idx / PTRS_PER_SECTOR),
+                     idx % PTRS_PER_SECTOR);
+  return NO_SECTOR;
+}
+
+static char zeros[DISK_SECTOR_SIZE];
+
+/* Fills data sector SECTOR with zeros. */
+static void
+zero_sector (disk_sector_t sector)
+{
+  cache_write (sector, zeros, 0, DISK_SECTOR_SIZE);
+}
+
+/* Stores SECTOR into entry I of index block BLOCK. */
+static void
+write_ptr (disk_sector_t block, size_t i, disk_sector_t sector)
+{
+  log_write (block, &sector, i * sizeof sector, sizeof sector);
+}
+
+/* Allocates a zeroed index block near HINT into *SECTORP, unless
+   it already holds one.  Returns false if the disk is full. */
+static bool
+alloc_zeroed (disk_sector_t *sectorp, disk_sector_t hint)
+{
+  if (*sectorp != NO_SECTOR)
+    return true;
+  if (!free_map_allocate_near (1, hint, sectorp))
+    return false;
+  log_write (*sectorp, zeros, 0, DISK_SECTOR_SIZE);
+  return true;
+}
+
+/* Stores entry I of index block BLOCK into *SECTORP, allocating a
+   zeroed sector near HINT for it first if it is NO_SECTOR.
+   Returns false if the disk is full. */
+static bool
+alloc_ptr (disk_sector_t block, size_t i, disk_sector_t *sectorp,
+           disk_sector_t hint)
+{
+  *sectorp = read_ptr (block, i);
+  if (*sectorp != NO_SECTOR)
+    return true;
+  if (!alloc_zeroed (sectorp, hint))
+    return false;
+  write_ptr (block, i, *sectorp);
+  return true;
+}
+
+/* Makes DATA, an allocated sector, data block IDX of DISK_INODE,
+   allocating any index blocks on the way to it just past DATA,
+   and keeps DISK_INODE's extent count up to date.  The caller
+   must write DISK_INODE back.  Returns false if IDX is beyond the
+   largest file or the disk is full. */
+static bool
+index_link (struct inode_disk *disk_inode, size_t idx, disk_sector_t data)
+{
+  size_t i = idx;
+  disk_sector_t prev, next, block;
+
+  if (i < DIRECT_CNT)
+    disk_inode->direct[i] = data;
+  else if ((i -= DIRECT_CNT) < PTRS_PER_SECTOR)
+    {
+      if (!alloc_zeroed (&disk_inode->indirect, data + 1))
+        return false;
+      write_ptr (disk_inode->indirect, i, data);
+    }
+  else if ((i -= PTRS_PER_SECTOR) < PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+    {
+      if (!alloc_zeroed (&disk_inode->doubly_indirect, data + 1)
+          || !alloc_ptr (disk_inode->doubly_indirect, i / PTRS_PER_SECTOR,
+                         &block, data + 1))
+        return false;
+      write_ptr (block, i % PTRS_PER_SECTOR, data);
+    }
+  else
+    return false;
+
+  /* DATA starts a new extent unless it continues or joins the
+     runs of its neighbors. */
+  prev = idx > 0 ? index_lookup (disk_inode, idx - 1) : NO_SECTOR;
+  next = idx + 1 < MAX_BLOCKS ? index_lookup (disk_inode, idx + 1) : NO_SECTOR;
+  disk_inode->extent_cnt++;
+  if (prev != NO_SECTOR && prev + 1 == data)
+    disk_inode->extent_cnt--;
+  if (next != NO_SECTOR && next == data + 1)
+    disk_inode->extent_cnt--;
+  return true;
+}
+
+/* Allocates a sector for data block IDX of DISK_INODE,
+   which is stored in sector INODE_SECTOR, and stores it into
+   *SECTORP.  The sector is placed right after the previous block
+   when that is free, extending the file's last extent in place.
+   The caller must write DISK_INODE back.  Returns false if IDX is
+   beyond the largest file or the disk is full. */
+static bool
+index_allocate (struct inode_disk *disk_inode, disk_sector_t inode_sector,
+                size_t idx, disk_sector_t *sectorp)
+{
+  disk_sector_t prev = idx > 0 ? index_lookup (disk_inode, idx - 1) : NO_SECTOR;
+  disk_sector_t hint = (prev != NO_SECTOR ? prev : inode_sector) + 1;
+
+  if (idx >= MAX_BLOCKS || !free_map_allocate_near (1, hint, sectorp))
+    return false;
+  if (!index_link (disk_inode, idx, *sectorp))
+    {
+      free_map_release (*sectorp, 1);
+      return false;
+    }
+  return true;
+}
+
+/* Frees BLOCK, which is a data block if LEVEL is 0 and otherwise
+   an index block whose entries are of level LEVEL - 1. */
+static void
+release_block (disk_sector_t block, int level)
+{
+  if (block == NO_SECTOR)
+    return;
+
+  if (level > 0)
+    {
+      size_t i;
+
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        release_block (read_ptr (block, i), level - 1);
+    }
+  free_map_release (block, 1);
+}
+
+/* Frees every data and index block of DISK_INODE. */
+static void
+release_blocks (struct inode_disk *disk_inode)
+{
+  size_t i;
+
+  if (disk_inode->is_inline)
+    return;
+  for (i = 0; i < DIRECT_CNT; i++)
+    release_block (disk_inode->direct[i], 0);
+  release_block (disk_inode->indirect, 1);
+  release_block (disk_inode->doubly_indirect, 2);
+}
+
 /* Returns the disk sector that contains byte offset POS within
-   INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   INODE, or NO_SECTOR if that byte lies in a hole or past the
+   initialized watermark.  Must be called with INODE's lock
+   held. */
 static disk_sector_t
 byte_to_sector (const struct inode *inode, off_t pos) 
 {
+  size_t idx = pos / DISK_SECTOR_SIZE;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / DISK_SECTOR_SIZE;
-  else
-    return -1;
+  ASSERT (lock_held_by_current_thread (&inode->lock));
+  if (idx >= inode->data.initialized)
+    return NO_SECTOR;
+  return index_lookup (&inode->data, idx);
+}
+
+/* Moves INODE's initialized watermark past data block IDX,
+   zeroing the allocated blocks it passes so that they go on
+   reading as zeros, except block IDX itself if OVERWRITE says
+   the caller is about to overwrite all of it.  The caller must
+   write INODE's data back.  Must be called with INODE's lock
+   held. */
+static void
+initialize_through (struct inode *inode, size_t idx, bool overwrite)
+{
+  struct inode_disk *disk_inode = &inode->data;
+
+  ASSERT (lock_held_by_current_thread (&inode->lock));
+  for (; disk_inode->initialized <= idx; disk_inode->initialized++)
+    {
+      disk_sector_t sector = index_lookup (disk_inode,
+                                           disk_inode->initialized);
+
+      if (sector == NO_SECTOR
+          || (overwrite && disk_inode->initialized == idx))
+        continue;
+      if (inode->metadata)
+        log_write (sector, zeros, 0, DISK_SECTOR_SIZE);
+      else
+        zero_sector (sector);
+    }
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Writes data blocks START up to END of INODE to disk, if they
+   are cached and dirty. */
+static void
+flush_blocks (struct inode *inode, size_t start, size_t end)
+{
+  size_t idx;
+
+  for (idx = start; idx < end; idx++)
+    {
+      disk_sector_t sector;
+
+      lock_acquire (&inode->lock);
+      sector = index_lookup (&inode->data, idx);
+      lock_release (&inode->lock);
+      if (sector != NO_SECTOR)
+        cache_flush_sector (sector);
+    }
+}
+
+/* Moves INODE's inline data out to a newly allocated first data
+   block, leaving INODE with an empty block index.  The caller
+   must write INODE's data back.  Returns false if memory or disk
+   allocation fails, leaving INODE unchanged.  Must be called with
+   INODE's lock held. */
+static bool
+move_inline_data (struct inode *inode)
+{
+  struct inode_disk *disk_inode = &inode->data;
+  off_t length = disk_inode->length;
+  disk_sector_t sector;
+  uint8_t *block;
+
+  ASSERT (lock_held_by_current_thread (&inode->lock));
+  ASSERT (disk_inode->is_inline);
+
+  block = calloc (1, DISK_SECTOR_SIZE);
+  if (block == NULL)
+    return false;
+  memcpy (block, disk_inode->inline_data, length);
+
+  memset (disk_inode->inline_data, 0, INLINE_MAX);
+  disk_inode->is_inline = false;
+  disk_inode->initialized = 0;
+  if (length > 0)
+    {
+      if (!index_allocate (disk_inode, inode->sector, 0, &sector))
+        {
+          memcpy (disk_inode->inline_data, block, length);
+          disk_inode->is_inline = true;
+          free (block);
+          return false;
+        }
+      if (inode->metadata)
+        log_write (sector, block, 0, DISK_SECTOR_SIZE);
+      else
+        cache_write (sector, block, 0, DISK_SECTOR_SIZE);
+      disk_inode->initialized = 1;
+    }
+  free (block);
+  return true;
+}
+
+/* Table of in-memory inodes by sector, so that opening a single
+   inode twice returns the same `struct inode'.  Besides the open
+   inodes, it holds up to CLOSED_MAX recently closed ones, kept on
+   CLOSED_INODES with the most recently closed first, so that
+   reopening a hot file does not read its inode again. */
+#define CLOSED_MAX 16
+static struct hash inodes;
+static struct list closed_inodes;
+static size_t closed_cnt;
+static struct lock inodes_lock;
+
+/* Returns a hash of inode E's sector. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, hash_elem)->sector);
+}
+
+/* Returns true if inode A's sector precedes inode B's. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, hash_elem)->sector
+          < hash_entry (b, struct inode, hash_elem)->sector);
+}
+
+/* Statistics. */
+static long long extent_file_cnt;       /* Files with data, at last close. */
+static long long extent_total;          /* Their extents. */
+static long long inline_file_cnt;       /* Inline files, at last close. */
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&inodes, inode_hash, inode_less, NULL);
+  list_init (&closed_inodes);
+  lock_init (&inodes_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -81,25 +444,45 @@ inode_create (disk_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
 
+  if (length > INODE_MAX_LENGTH)
+    return false;
+
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
+      bool is_inline = length <= (off_t) INLINE_MAX;
+      size_t sectors = is_inline ? 0 : bytes_to_sectors (length);
+      disk_sector_t start;
+      size_t i;
+
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start))
+      disk_inode->is_inline = is_inline;
+
+      /* Allocate the initial blocks of a file too big to be
+         inline now rather than leaving holes, so that writing them
+         later (the free map's own file, in particular) never needs
+         to allocate.  Take them as a single run right after the
+         inode if one is free.  They lie past the initialized
+         watermark, so they need not be zeroed. */
+      success = true;
+      if (sectors > 1 && free_map_allocate_near (sectors, sector + 1, &start))
         {
-          disk_write (filesys_disk, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[DISK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                disk_write (filesys_disk, disk_inode->start + i, zeros); 
-            }
-          success = true; 
-        } 
+          for (i = 0; i < sectors; i++)
+            if (!success || !index_link (disk_inode, i, start + i))
+              {
+                success = false;
+                free_map_release (start + i, 1);
+              }
+        }
+      else
+        for (i = 0; i < sectors && success; i++)
+          success = index_allocate (disk_inode, sector, i, &start);
+
+      if (success)
+        log_write (sector, disk_inode, 0, DISK_SECTOR_SIZE);
+      else
+        release_blocks (disk_inode);
       free (disk_inode);
     }
   return success;
@@ -111,33 +494,48 @@ inode_create (disk_sector_t sector, off_t length)
 struct inode *
 inode_open (disk_sector_t sector) 
 {
-  struct list_elem *e;
+  struct inode key;
+  struct hash_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  /* Check whether this inode is already in memory, and take it
+     off the closed list if it was closed. */
+  key.sector = sector;
+  lock_acquire (&inodes_lock);
+  e = hash_find (&inodes, &key.hash_elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      inode = hash_entry (e, struct inode, hash_elem);
+      if (inode->open_cnt == 0)
         {
-          inode_reopen (inode);
-          return inode; 
+          list_remove (&inode->elem);
+          closed_cnt--;
         }
+      inode->open_cnt++;
+      lock_release (&inodes_lock);
+      return inode;
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize.  Reading the inode with inodes_lock held keeps
+     anyone else opening it from seeing it half read. */
   inode->sector = sector;
+  hash_insert (&inodes, &inode->hash_elem);
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  disk_read (filesys_disk, inode->sector, &inode->data);
+  inode->metadata = false;
+  lock_init (&inode->lock);
+  lock_init (&inode->dir_lock);
+  cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+  lock_release (&inodes_lock);
   return inode;
 }
 
@@ -146,7 +544,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&inodes_lock);
+      inode->open_cnt++;
+      lock_release (&inodes_lock);
+    }
   return inode;
 }
 
@@ -158,7 +560,8 @@ inode_get_inumber (const struct inode *inode)
 }
 
 /* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
+   If this was the last reference to INODE, moves it to the closed
+   list, whose oldest inodes are freed.
    If INODE was also a removed inode, frees its blocks. */
 void
 inode_close (struct inode *inode) 
@@ -168,21 +571,45 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
+  lock_acquire (&inodes_lock);
   if (--inode->open_cnt == 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
+      /* Deallocate blocks if removed.  No one else can reach the
+         inode once it is out of the table. */
       if (inode->removed) 
         {
+          hash_delete (&inodes, &inode->hash_elem);
+          lock_release (&inodes_lock);
+          log_begin ();
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          release_blocks (&inode->data);
+          log_end ();
+          free (inode);
+          return;
+        }
+
+      if (inode->data.is_inline)
+        inline_file_cnt++;
+      else if (inode->data.extent_cnt > 0)
+        {
+          extent_file_cnt++;
+          extent_total += inode->data.extent_cnt;
         }
 
-      free (inode); 
+      /* Keep it around for a later open, dropping the least
+         recently closed inode if there are too many. */
+      list_push_front (&closed_inodes, &inode->elem);
+      if (++closed_cnt > CLOSED_MAX)
+        {
+          struct inode *victim = list_entry (list_pop_back (&closed_inodes),
+                                             struct inode, elem);
+
+          hash_delete (&inodes, &victim->hash_elem);
+          closed_cnt--;
+          free (victim);
+        }
     }
+  lock_release (&inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -191,7 +618,33 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&inode->lock);
   inode->removed = true;
+  lock_release (&inode->lock);
+}
+
+/* Marks INODE as holding file system metadata, such as a
+   directory or the free map, so that writes to its data are
+   logged like writes to the inode itself. */
+void
+inode_set_metadata (struct inode *inode)
+{
+  inode->metadata = true;
+}
+
+/* Acquires INODE's directory lock, which callers use to make a
+   sequence of operations on INODE atomic. */
+void
+inode_lock (struct inode *inode)
+{
+  lock_acquire (&inode->dir_lock);
+}
+
+/* Releases INODE's directory lock. */
+void
+inode_unlock (struct inode *inode)
+{
+  lock_release (&inode->dir_lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -202,16 +655,37 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+
+  /* A small file is read straight out of its inode. */
+  lock_acquire (&inode->lock);
+  if (inode->data.is_inline)
+    {
+      if (offset >= 0 && offset < inode->data.length)
+        {
+          bytes_read = inode->data.length - offset;
+          if (size < bytes_read)
+            bytes_read = size;
+          memcpy (buffer, inode->data.inline_data + offset, bytes_read);
+        }
+      lock_release (&inode->lock);
+      return bytes_read;
+    }
+  lock_release (&inode->lock);
 
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      disk_sector_t sector_idx = byte_to_sector (inode, offset);
+      disk_sector_t sector_idx;
       int sector_ofs = offset % DISK_SECTOR_SIZE;
+      off_t length;
+
+      lock_acquire (&inode->lock);
+      sector_idx = byte_to_sector (inode, offset);
+      length = inode->data.length;
+      lock_release (&inode->lock);
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left = length - offset;
       int sector_left = DISK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -220,99 +694,201 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) 
-        {
-          /* Read full sector directly into caller's buffer. */
-          disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (DISK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          disk_read (filesys_disk, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      if (sector_idx != NO_SECTOR)
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+
+  /* Sequential readers will want the next sector soon. */
+  if (bytes_read > 0 && ROUND_UP (offset, DISK_SECTOR_SIZE) < inode_length (inode))
+    {
+      disk_sector_t next;
+
+      lock_acquire (&inode->lock);
+      next = byte_to_sector (inode, ROUND_UP (offset, DISK_SECTOR_SIZE));
+      lock_release (&inode->lock);
+      if (next != NO_SECTOR)
+        cache_readahead (next);
+    }
 
   return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or the file reaches
+   INODE_MAX_LENGTH.  Writing past end of file extends INODE; any
+   gap between the old end and OFFSET is left as a hole.  The new
+   length is published only after the data is in place, so
+   concurrent readers never see the extension before its
+   contents.  Likewise, blocks that this write zeroes or fills in
+   reach the disk before the inode change that exposes them is
+   logged, so a crash never exposes what they held before. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  bool changed = false;
+  bool logging = false;
+  size_t fresh_start = 0, fresh_end = 0;  /* Blocks zeroed or allocated. */
 
-  if (inode->deny_write_cnt)
+  if (offset < 0 || offset >= INODE_MAX_LENGTH)
     return 0;
 
+  lock_acquire (&inode->lock);
+  if (inode->deny_write_cnt)
+    {
+      lock_release (&inode->lock);
+      return 0;
+    }
+  lock_release (&inode->lock);
+
+  /* Growing the file changes its inode, which takes a
+     transaction.  So does writing a small file, whose data is in
+     its inode, and filling a hole or moving the initialized
+     watermark, found below.  A file stops being small only once,
+     so checking without the lock at worst starts a transaction
+     that is not needed. */
+  if (size > inode_length (inode) - offset || inode->data.is_inline)
+    {
+      log_begin ();
+      logging = true;
+    }
+
+  /* A small file is written straight into its inode, unless it is
+     growing too big for that.  The inode goes through the log, so
+     that replaying an older image of it cannot undo the write. */
+  lock_acquire (&inode->lock);
+  if (inode->data.is_inline)
+    {
+      ASSERT (logging);
+      if (offset >= 0 && offset < (off_t) INLINE_MAX
+          && size <= (off_t) INLINE_MAX - offset)
+        {
+          memcpy (inode->data.inline_data + offset, buffer, size);
+          if (offset + size > inode->data.length)
+            inode->data.length = offset + size;
+          log_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+          lock_release (&inode->lock);
+          log_end ();
+          return size;
+        }
+
+      if (!move_inline_data (inode))
+        {
+          lock_release (&inode->lock);
+          log_end ();
+          return 0;
+        }
+      fresh_end = inode->data.initialized;
+      changed = true;
+    }
+  lock_release (&inode->lock);
+
   while (size > 0) 
     {
-      /* Sector to write, starting byte offset within sector. */
-      disk_sector_t sector_idx = byte_to_sector (inode, offset);
+      /* Block and sector to write, starting byte offset within
+         sector. */
+      size_t block_idx = offset / DISK_SECTOR_SIZE;
+      disk_sector_t sector_idx;
       int sector_ofs = offset % DISK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left in the largest file, bytes left in sector,
+         lesser of the two. */
+      off_t inode_left = INODE_MAX_LENGTH - offset;
       int sector_left = DISK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually write into this sector. */
       int chunk_size = size < min_left ? size : min_left;
+      bool fresh = false;
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) 
+      /* Find the sector, filling in a hole or growing the file. */
+      lock_acquire (&inode->lock);
+      sector_idx = byte_to_sector (inode, offset);
+      if (sector_idx == NO_SECTOR && !logging)
         {
-          /* Write full sector directly to disk. */
-          disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
+          /* Changing the inode takes a transaction, which must not
+             be started with the lock held. */
+          lock_release (&inode->lock);
+          log_begin ();
+          logging = true;
+          lock_acquire (&inode->lock);
+          sector_idx = byte_to_sector (inode, offset);
         }
-      else 
+      if (sector_idx == NO_SECTOR && block_idx >= inode->data.initialized)
         {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
+          if (fresh_start == fresh_end)
+            fresh_start = inode->data.initialized;
+          fresh_end = block_idx + 1;
+          initialize_through (inode, block_idx,
+                              chunk_size == DISK_SECTOR_SIZE);
+          sector_idx = byte_to_sector (inode, offset);
+          fresh = true;
+          changed = true;
+        }
+      if (sector_idx == NO_SECTOR)
+        {
+          if (!index_allocate (&inode->data, inode->sector, block_idx,
+                               &sector_idx))
             {
-              bounce = malloc (DISK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
+              lock_release (&inode->lock);
+              break;
             }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            disk_read (filesys_disk, sector_idx, bounce);
-          else
-            memset (bounce, 0, DISK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          disk_write (filesys_disk, sector_idx, bounce); 
+          if (chunk_size < DISK_SECTOR_SIZE)
+            zero_sector (sector_idx);
+          if (fresh_start == fresh_end)
+            fresh_start = block_idx;
+          fresh_end = block_idx + 1;
+          fresh = true;
+          changed = true;
         }
 
+      /* Readers can reach a block just initialized or allocated as
+         soon as the lock is released.  It may not have been
+         zeroed, so fill it in before letting them at it. */
+      if (!fresh)
+        lock_release (&inode->lock);
+      if (inode->metadata)
+        log_write (sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
+      else
+        cache_write (sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
+      if (fresh)
+        lock_release (&inode->lock);
+
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  /* Metadata goes through the log with the inode, but data blocks
+     do not, so push them out before the inode that exposes them
+     is logged. */
+  if (!inode->metadata)
+    flush_blocks (inode, fresh_start, fresh_end);
+
+  lock_acquire (&inode->lock);
+  if (offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      changed = true;
+    }
+  if (changed)
+    log_write (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+  lock_release (&inode->lock);
+  if (logging)
+    log_end ();
 
   return bytes_written;
 }
@@ -322,8 +898,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&inode->lock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,9 +910,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&inode->lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -343,3 +923,16 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Prints inode layout statistics. */
+void
+inode_print_stats (void)
+{
+  long long avg100 = extent_file_cnt > 0
+                     ? extent_total * 100 / extent_file_cnt : 0;
+
+  printf ("Inodes: %lld files closed with %lld extents "
+          "(%lld.%02lld extents per file), %lld inline\n",
+          extent_file_cnt, extent_total, avg100 / 100, avg100 % 100,
+          inline_file_cnt);
+}
@@ -0,0 +1,417 @@
+#include "filesys/log.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Write-ahead log of file system metadata.
+
+   Operations that change metadata (creating and removing files,
+   growing them, releasing their blocks) run between log_begin()
+   and log_end(), and write inode, index, directory and free map
+   sectors with log_write().  Those sectors stay in the buffer
+   cache, held back from the disk, until the transaction commits.
+   The last of a group of concurrent operations to end commits
+   the whole group: it appends the sectors' images to the log in
+   one sequential pass and then writes the log header, which is
+   the commit point.  After that the sectors may reach their home
+   locations at any time.  The checkpoint thread later makes sure
+   they have and empties the log.  At boot, any committed sectors
+   still in the log are copied home again.
+
+   An operation reserves OP_MAX_BLOCKS log blocks when it begins,
+   which is enough for most.  One that writes more, for example to
+   rehash a large directory, may fill the log or the part of the
+   cache that may be held back.  Its next write then forces a
+   commit of everything pending, checkpointing too if the log is
+   full, so that every sector still goes through the log.  A crash
+   may then leave the operations in progress half done, but never
+   lets a sector reach home ahead of its log image.
+
+   A freed block may still have an image in the log, which replay
+   would copy over whatever the block holds by then.  So the free
+   map does not reuse a freed block until a checkpoint has emptied
+   the log (see log_checkpoint_cnt()). */
+
+/* Log blocks reserved for each operation, a typical upper bound
+   but not a limit. */
+#define OP_MAX_BLOCKS 8
+
+/* At most this many sectors are held back in the buffer cache,
+   so that the cache always has room for other sectors. */
+#define PENDING_MAX (CACHE_SIZE / 2)
+
+/* Committed sectors are checkpointed this often. */
+#define CHECKPOINT_INTERVAL (2 * TIMER_FREQ)
+
+/* Log blocks moved to or from the disk by one command. */
+#define BATCH_BLOCKS 16
+
+/* Identifies a log header. */
+#define LOG_MAGIC 0x4c4f4721
+
+/* On-disk log header.
+   Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct log_header
+  {
+    unsigned magic;                     /* Magic number. */
+    uint32_t cnt;                       /* Committed blocks in the log. */
+    disk_sector_t sectors[LOG_BLOCKS];  /* Home sector of each block. */
+  };
+
+static struct lock log_lock;            /* Guards everything below. */
+static struct condition log_changed;    /* Signaled when state changes. */
+static int outstanding;                 /* Operations in progress. */
+static bool committing;                 /* A group is committing. */
+static bool writing;                    /* A commit is writing the log. */
+
+/* Sectors written by the operations in progress, not yet in the
+   log. */
+static disk_sector_t pending[PENDING_MAX];
+static size_t pending_cnt;
+
+/* Committed sectors in the log, in log order. */
+static struct log_header header;
+
+/* Staging area for log blocks replayed at boot. */
+static uint8_t batch[BATCH_BLOCKS][DISK_SECTOR_SIZE];
+
+/* Sectors being committed and their images, taken from PENDING so
+   that the log can be written without log_lock.  Used only by the
+   commit that set WRITING. */
+static disk_sector_t commit_sectors[PENDING_MAX];
+static uint8_t commit_images[PENDING_MAX][DISK_SECTOR_SIZE];
+static struct log_header commit_header;
+
+/* Statistics. */
+static long long op_cnt;                /* Operations committed. */
+static long long group_op_cnt;          /* Operations in current group. */
+static long long commit_cnt;            /* Groups committed. */
+static long long checkpoint_cnt;        /* Checkpoints that emptied the log. */
+static long long empty_cnt;             /* Checkpoints, even of an empty log. */
+static long long forced_cnt;            /* Commits forced by a full log. */
+
+static thread_func checkpoint_thread;
+static void commit (void);
+static void checkpoint (void);
+static void make_room (void);
+
+/* Initializes the log, emptying it if FORMAT is true and
+   otherwise replaying whatever it holds. */
+void
+log_init (bool format)
+{
+  ASSERT (sizeof header == DISK_SECTOR_SIZE);
+
+  lock_init (&log_lock);
+  cond_init (&log_changed);
+
+  if (!format)
+    {
+      disk_read (filesys_disk, LOG_SECTOR, &header);
+      if (header.magic == LOG_MAGIC)
+        {
+          size_t cnt = header.cnt < LOG_BLOCKS ? header.cnt : LOG_BLOCKS;
+          size_t i, j, n;
+
+          for (i = 0; i < cnt; i += n)
+            {
+              n = cnt - i < BATCH_BLOCKS ? cnt - i : BATCH_BLOCKS;
+              disk_read_multiple (filesys_disk, LOG_SECTOR + 1 + i, n, batch);
+              for (j = 0; j < n; j++)
+                disk_write (filesys_disk, header.sectors[i + j], batch[j]);
+            }
+        }
+    }
+
+  memset (&header, 0, sizeof header);
+  header.magic = LOG_MAGIC;
+  disk_write (filesys_disk, LOG_SECTOR, &header);
+
+  thread_create ("log-ckpt", PRI_DEFAULT, checkpoint_thread, NULL);
+}
+
+/* Checkpoints the log for shutdown. */
+void
+log_done (void)
+{
+  log_checkpoint ();
+}
+
+/* Starts a file system operation.  Operations may nest; only the
+   outermost one counts. */
+void
+log_begin (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->log_depth++ > 0)
+    return;
+
+  lock_acquire (&log_lock);
+  for (;;)
+    {
+      size_t reserved = pending_cnt + (outstanding + 1) * OP_MAX_BLOCKS;
+
+      if (committing)
+        cond_wait (&log_changed, &log_lock);
+      else if (reserved > PENDING_MAX && outstanding > 0)
+        cond_wait (&log_changed, &log_lock);
+      else if (header.cnt + reserved > LOG_BLOCKS)
+        {
+          if (outstanding > 0)
+            cond_wait (&log_changed, &log_lock);
+          else
+            checkpoint ();
+        }
+      else
+        break;
+    }
+  outstanding++;
+  lock_release (&log_lock);
+}
+
+/* Ends a file system operation.  The last operation of a group to
+   end commits the group. */
+void
+log_end (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->log_depth > 0);
+  if (t->log_depth > 1)
+    {
+      t->log_depth--;
+      return;
+    }
+
+  lock_acquire (&log_lock);
+  group_op_cnt++;
+  if (outstanding > 1)
+    {
+      outstanding--;
+      t->log_depth = 0;
+      cond_broadcast (&log_changed, &log_lock);
+      lock_release (&log_lock);
+      return;
+    }
+
+  /* Add the group's free map changes while still inside the
+     transaction, so that they are logged with it. */
+  committing = true;
+  lock_release (&log_lock);
+  free_map_flush ();
+  t->log_depth = 0;
+
+  lock_acquire (&log_lock);
+  outstanding--;
+  commit ();
+  committing = false;
+  cond_broadcast (&log_changed, &log_lock);
+  lock_release (&log_lock);
+}
+
+/* Returns true if SECTOR is pending.  Must be called with log_lock
+   held. */
+static bool
+is_pending (disk_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < pending_cnt; i++)
+    if (pending[i] == sector)
+      return true;
+  return false;
+}
+
+/* Copies SIZE bytes from BUFFER into SECTOR starting at byte OFS,
+   as part of the calling thread's transaction if it is in one. */
+void
+log_write (disk_sector_t sector, const void *buffer, int ofs, int size)
+{
+  if (thread_current ()->log_depth == 0)
+    {
+      cache_write (sector, buffer, ofs, size);
+      return;
+    }
+
+  /* Keep log_lock until the write is in the cache, so that a
+     forced commit cannot slip in between and leave SECTOR held
+     back but no longer pending. */
+  lock_acquire (&log_lock);
+  if (!is_pending (sector))
+    {
+      make_room ();
+      if (!is_pending (sector))
+        pending[pending_cnt++] = sector;
+    }
+  cache_write_logged (sector, buffer, ofs, size);
+  lock_release (&log_lock);
+}
+
+/* Appends the pending sectors to the log and commits them.  Must
+   be called with log_lock held, which is released while the log is
+   written.  Called with operations in progress only to force a
+   commit; their writes meanwhile become pending again. */
+static void
+commit (void)
+{
+  size_t cnt, start, i;
+  long long ops;
+
+  while (writing)
+    cond_wait (&log_changed, &log_lock);
+
+  if (pending_cnt == 0)
+    {
+      group_op_cnt = 0;
+      return;
+    }
+
+  /* Take the pending sectors' images and their places in the log. */
+  cnt = pending_cnt;
+  start = header.cnt;
+  for (i = 0; i < cnt; i++)
+    {
+      commit_sectors[i] = pending[i];
+      cache_read (pending[i], commit_images[i], 0, DISK_SECTOR_SIZE);
+      header.sectors[start + i] = pending[i];
+    }
+  header.cnt += cnt;
+  commit_header = header;
+  pending_cnt = 0;
+  ops = group_op_cnt;
+  group_op_cnt = 0;
+  writing = true;
+  lock_release (&log_lock);
+
+  disk_write_multiple (filesys_disk, LOG_SECTOR + 1 + start, cnt,
+                       commit_images);
+  disk_write (filesys_disk, LOG_SECTOR, &commit_header);
+
+  /* Committed, so the sectors may now go home, unless written
+     again in the meantime. */
+  lock_acquire (&log_lock);
+  for (i = 0; i < cnt; i++)
+    if (!is_pending (commit_sectors[i]))
+      cache_unlog (commit_sectors[i]);
+  writing = false;
+  commit_cnt++;
+  op_cnt += ops;
+  cond_broadcast (&log_changed, &log_lock);
+}
+
+/* Writes every committed sector to its home location and empties
+   the log.  Must be called with log_lock held and nothing
+   pending. */
+static void
+checkpoint (void)
+{
+  size_t i;
+
+  ASSERT (pending_cnt == 0 && !writing);
+
+  if (header.cnt > 0)
+    {
+      for (i = 0; i < header.cnt; i++)
+        cache_flush_sector (header.sectors[i]);
+      header.cnt = 0;
+      disk_write (filesys_disk, LOG_SECTOR, &header);
+      checkpoint_cnt++;
+    }
+  empty_cnt++;
+}
+
+/* Makes room for one more pending sector, forcing a commit of
+   what the operations in progress have written so far if the log
+   or the part of the cache that may be held back is full, and
+   checkpointing if the log is.  Must be called with log_lock
+   held. */
+static void
+make_room (void)
+{
+  while (pending_cnt >= PENDING_MAX || header.cnt + pending_cnt >= LOG_BLOCKS)
+    {
+      if (writing)
+        cond_wait (&log_changed, &log_lock);
+      else if (pending_cnt > 0)
+        {
+          commit ();
+          forced_cnt++;
+        }
+      else
+        checkpoint ();
+    }
+}
+
+/* Commits what the operations in progress have written so far and
+   empties the log, so that the blocks they have freed may be
+   reused.  Those operations lose their atomicity, so this is for
+   when the alternative is to fail, as when the disk is full but
+   for blocks freed since the last checkpoint. */
+void
+log_force_checkpoint (void)
+{
+  lock_acquire (&log_lock);
+  while (pending_cnt > 0 || writing)
+    commit ();
+  checkpoint ();
+  forced_cnt++;
+  cond_broadcast (&log_changed, &log_lock);
+  lock_release (&log_lock);
+}
+
+/* Returns the number of checkpoints so far.  A block freed before
+   a checkpoint has no image left in the log. */
+long long
+log_checkpoint_cnt (void)
+{
+  long long cnt;
+
+  lock_acquire (&log_lock);
+  cnt = empty_cnt;
+  lock_release (&log_lock);
+  return cnt;
+}
+
+/* Waits until no operation is in progress, then checkpoints. */
+void
+log_checkpoint (void)
+{
+  lock_acquire (&log_lock);
+  while (outstanding > 0 || committing)
+    cond_wait (&log_changed, &log_lock);
+  checkpoint ();
+  cond_broadcast (&log_changed, &log_lock);
+  lock_release (&log_lock);
+}
+
+/* Checkpoints every CHECKPOINT_INTERVAL ticks, so that the log
+   rarely fills up in the middle of an operation. */
+static void
+checkpoint_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (CHECKPOINT_INTERVAL);
+      log_checkpoint ();
+    }
+}
+
+/* Prints log statistics. */
+void
+log_print_stats (void)
+{
+  long long per100 = commit_cnt > 0 ? op_cnt * 100 / commit_cnt : 0;
+
+  printf ("Log: %lld transactions in %lld commits "
+          "(%lld.%02lld per commit), %lld checkpoints, "
+          "%lld forced commits\n",
+          op_cnt, commit_cnt, per100 / 100, per100 % 100,
+          checkpoint_cnt, forced_cnt);
+}
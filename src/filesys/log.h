@@ -0,0 +1,22 @@
+#ifndef FILESYS_LOG_H
+#define FILESYS_LOG_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+/* Sectors of the metadata log: a header followed by LOG_BLOCKS
+   logged sector images. */
+#define LOG_BLOCKS 126
+#define LOG_SECTORS (1 + LOG_BLOCKS)
+
+void log_init (bool format);
+void log_done (void);
+void log_begin (void);
+void log_end (void);
+void log_write (disk_sector_t, const void *, int ofs, int size);
+void log_checkpoint (void);
+void log_force_checkpoint (void);
+long long log_checkpoint_cnt (void);
+void log_print_stats (void);
+
+#endif /* filesys/log.h */
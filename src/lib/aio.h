@@ -0,0 +1,33 @@
+#ifndef __LIB_AIO_H
+#define __LIB_AIO_H
+
+#include <stdbool.h>
+
+/* Largest asynchronous request, in bytes, and most requests a
+   process may have submitted and not yet reaped.  Each request
+   keeps its buffer's pages pinned in memory until it is reaped,
+   so both are kept small. */
+#define AIO_MAX_SIZE (8 * 4096)
+#define AIO_MAX_PENDING 8
+
+/* An asynchronous read or write, as passed to the aio_submit
+   system call. */
+struct aio_request
+  {
+    int fd;                     /* File descriptor of an open file. */
+    void *buffer;               /* Data to write, or room to read into. */
+    unsigned size;              /* Bytes to transfer. */
+    unsigned offset;            /* File offset to transfer at. */
+    bool write;                 /* Write BUFFER, or read into it? */
+  };
+
+/* A completed asynchronous request, as reported by the aio_poll
+   and aio_wait system calls. */
+struct aio_completion
+  {
+    int id;                     /* As returned by aio_submit. */
+    int result;                 /* Bytes transferred, as for read
+                                   or write. */
+  };
+
+#endif /* lib/aio.h */
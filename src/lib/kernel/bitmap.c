@@ -359,6 +359,23 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes bytes OFS through OFS + SIZE of B's file image, as far
+   as they exist, to the same place in FILE.  Return true if
+   successful, false otherwise. */
+bool
+bitmap_write_at (const struct bitmap *b, struct file *file,
+                 size_t ofs, size_t size)
+{
+  size_t file_size = byte_cnt (b->bit_cnt);
+
+  if (ofs >= file_size)
+    return true;
+  if (size > file_size - ofs)
+    size = file_size - ofs;
+  return (size_t) file_write_at (file, (uint8_t *) b->bits + ofs,
+                                 size, ofs) == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
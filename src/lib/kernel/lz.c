@@ -0,0 +1,156 @@
+#include "lz.h"
+#include <debug.h>
+#include <string.h>
+
+/* Back-reference limits. */
+#define MIN_MATCH 3                     /* Shortest match worth coding. */
+#define SHORT_MATCH (MIN_MATCH + 14)    /* Longest 2-byte match. */
+#define MAX_MATCH (SHORT_MATCH + 1 + 255) /* Longest 3-byte match. */
+#define MAX_DISTANCE 4095               /* Farthest reachable byte. */
+
+/* Marks an empty slot in the match table. */
+#define NO_POS 0xffff
+
+/* Hashes the 3 bytes at P into an index into the match table. */
+static inline unsigned
+hash3 (const uint8_t *p)
+{
+  uint32_t x = ((uint32_t) p[0] << 16) | ((uint32_t) p[1] << 8) | p[2];
+  return (x * 2654435761u) >> 22;
+}
+
+/* Compresses SRC_SIZE bytes from SRC into DST, which has room for
+   DST_SIZE bytes.  TABLE must point to LZ_TABLE_SIZE entries of
+   scratch space.  Returns the compressed size, or 0 if the output
+   would not fit in DST_SIZE bytes. */
+size_t
+lz_compress (const void *src_, size_t src_size,
+             void *dst_, size_t dst_size, uint16_t *table)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  uint8_t *ctrl = NULL;
+  size_t pos = 0, out = 0;
+  int item = 8;
+  size_t i;
+
+  ASSERT (src_size < NO_POS);
+  ASSERT (table != NULL);
+
+  for (i = 0; i < LZ_TABLE_SIZE; i++)
+    table[i] = NO_POS;
+
+  while (pos < src_size)
+    {
+      size_t cand = NO_POS;
+      size_t len = 0;
+
+      /* Start a new group. */
+      if (item == 8)
+        {
+          if (out >= dst_size)
+            return 0;
+          ctrl = &dst[out++];
+          *ctrl = 0;
+          item = 0;
+        }
+
+      /* Look for an earlier occurrence of the next 3 bytes. */
+      if (pos + MIN_MATCH <= src_size)
+        {
+          unsigned h = hash3 (src + pos);
+          cand = table[h];
+          table[h] = pos;
+          if (cand != NO_POS && pos - cand <= MAX_DISTANCE
+              && !memcmp (src + cand, src + pos, MIN_MATCH))
+            {
+              size_t max = src_size - pos;
+              if (max > MAX_MATCH)
+                max = MAX_MATCH;
+              len = MIN_MATCH;
+              while (len < max && src[cand + len] == src[pos + len])
+                len++;
+            }
+        }
+
+      if (len >= MIN_MATCH)
+        {
+          size_t dist = pos - cand;
+          size_t need = len > SHORT_MATCH ? 3 : 2;
+          if (out + need > dst_size)
+            return 0;
+          *ctrl |= 1 << item;
+          if (len > SHORT_MATCH)
+            {
+              dst[out++] = 0xf0 | (dist >> 8);
+              dst[out++] = dist & 0xff;
+              dst[out++] = len - SHORT_MATCH - 1;
+            }
+          else
+            {
+              dst[out++] = ((len - MIN_MATCH) << 4) | (dist >> 8);
+              dst[out++] = dist & 0xff;
+            }
+          pos += len;
+        }
+      else
+        {
+          if (out >= dst_size)
+            return 0;
+          dst[out++] = src[pos++];
+        }
+      item++;
+    }
+
+  return out;
+}
+
+/* Decompresses SRC_SIZE bytes of lz_compress() output from SRC
+   into DST, which has room for DST_SIZE bytes.  Returns the
+   number of bytes produced, or 0 if SRC is malformed. */
+size_t
+lz_decompress (const void *src_, size_t src_size,
+               void *dst_, size_t dst_size)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  size_t in = 0, out = 0;
+
+  while (in < src_size)
+    {
+      uint8_t ctrl = src[in++];
+      int item;
+
+      for (item = 0; item < 8 && in < src_size; item++)
+        if (ctrl & (1 << item))
+          {
+            size_t len, dist, i;
+
+            if (in + 2 > src_size)
+              return 0;
+            len = (src[in] >> 4) + MIN_MATCH;
+            dist = ((src[in] & 0x0f) << 8) | src[in + 1];
+            in += 2;
+            if (len > SHORT_MATCH)
+              {
+                if (in >= src_size)
+                  return 0;
+                len = SHORT_MATCH + 1 + src[in++];
+              }
+            if (dist == 0 || dist > out || out + len > dst_size)
+              return 0;
+
+            /* Byte by byte, since the source may overlap. */
+            for (i = 0; i < len; i++, out++)
+              dst[out] = dst[out - dist];
+          }
+        else
+          {
+            if (out >= dst_size)
+              return 0;
+            dst[out++] = src[in++];
+          }
+    }
+
+  return out;
+}
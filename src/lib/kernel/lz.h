@@ -0,0 +1,24 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Fast LZ77-style compressor for page-sized buffers.
+
+   The compressed stream is a sequence of groups.  Each group
+   starts with a control byte whose bits, least significant
+   first, describe up to 8 items: a 0 bit is a literal byte, a 1
+   bit is a back-reference encoded in 2 or 3 bytes with a 12-bit
+   distance and a length of 3 to 273 bytes.  Inputs must be
+   shorter than 64 kB. */
+
+/* Number of entries in the match table passed to lz_compress(). */
+#define LZ_TABLE_SIZE 1024
+
+size_t lz_compress (const void *src, size_t src_size,
+                    void *dst, size_t dst_size, uint16_t *table);
+size_t lz_decompress (const void *src, size_t src_size,
+                      void *dst, size_t dst_size);
+
+#endif /* lib/kernel/lz.h */
@@ -0,0 +1,23 @@
+#ifndef __LIB_RUSAGE_H
+#define __LIB_RUSAGE_H
+
+/* Virtual memory usage of a process, as reported by the
+   getrusage system call. */
+struct rusage
+  {
+    unsigned long minor_faults;         /* Page-ins without disk reads. */
+    unsigned long major_faults;         /* Page-ins that read the disk. */
+    unsigned long evictions;            /* Frames taken from the process. */
+    unsigned long swap_ins;             /* Pages read back from swap. */
+    unsigned long swap_outs;            /* Pages written to swap. */
+    unsigned long rss;                  /* Pages resident now. */
+    unsigned long max_rss;              /* Most pages resident at once. */
+    unsigned long rss_limit;            /* Resident set limit in pages. */
+    unsigned long local_evictions;      /* Frames given up to stay
+                                           within RSS_LIMIT. */
+    unsigned long long load_bytes;      /* Bytes paged in from files. */
+    unsigned long long ticks;           /* Timer ticks since the process
+                                           started. */
+  };
+
+#endif /* lib/rusage.h */
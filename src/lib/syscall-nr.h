@@ -28,7 +28,14 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_GETRUSAGE,              /* Reports virtual memory usage. */
+    SYS_RSSLIMIT,               /* Sets the resident set limit. */
+    SYS_AIO_SUBMIT,             /* Starts an asynchronous read or write. */
+    SYS_AIO_POLL,               /* Reports a completed request, if any. */
+    SYS_AIO_WAIT                /* Waits for a request to complete. */
   };
 
 #endif /* lib/syscall-nr.h */
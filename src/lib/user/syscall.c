@@ -182,3 +182,33 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+getrusage (struct rusage *usage)
+{
+  return syscall1 (SYS_GETRUSAGE, usage);
+}
+
+int
+rsslimit (int pages)
+{
+  return syscall1 (SYS_RSSLIMIT, pages);
+}
+
+int
+aio_submit (const struct aio_request *request)
+{
+  return syscall1 (SYS_AIO_SUBMIT, request);
+}
+
+bool
+aio_poll (struct aio_completion *completion)
+{
+  return syscall1 (SYS_AIO_POLL, completion);
+}
+
+bool
+aio_wait (struct aio_completion *completion)
+{
+  return syscall1 (SYS_AIO_WAIT, completion);
+}
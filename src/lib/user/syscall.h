@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <aio.h>
+#include <rusage.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +47,11 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int getrusage (struct rusage *);
+int rsslimit (int pages);
+int aio_submit (const struct aio_request *);
+bool aio_poll (struct aio_completion *);
+bool aio_wait (struct aio_completion *);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,140 @@
+/* Benchmarks asynchronous against synchronous reads.  Reads a
+   file twice, doing some computation on each chunk: first with
+   read(), one chunk after another, then keeping BUF_CNT
+   asynchronous reads in flight while earlier chunks are
+   processed.  Checks that both passes saw the same data and
+   reports how long each took, in timer ticks. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK_SIZE AIO_MAX_SIZE
+#define CHUNK_CNT 8
+#define BUF_CNT 3
+#define WORK_ROUNDS 8
+
+static char buf[BUF_CNT][CHUNK_SIZE];
+
+/* Stands in for real work on a chunk of data: hashes the SIZE
+   bytes at P WORK_ROUNDS times into HASH and returns the result. */
+static unsigned
+process (unsigned hash, const char *p, size_t size)
+{
+  int round;
+  size_t i;
+
+  for (round = 0; round < WORK_ROUNDS; round++)
+    for (i = 0; i < size; i++)
+      hash = (hash ^ (unsigned char) p[i]) * 16777619u;
+  return hash;
+}
+
+/* Returns timer ticks since the process started. */
+static unsigned long long
+ticks (void)
+{
+  struct rusage ru;
+
+  if (getrusage (&ru) != 0)
+    fail ("getrusage failed");
+  return ru.ticks;
+}
+
+/* Starts an asynchronous read of chunk I of FD into buffer B, and
+   returns its identifier. */
+static int
+submit (int fd, int i, int b)
+{
+  struct aio_request r;
+  int id;
+
+  r.fd = fd;
+  r.buffer = buf[b];
+  r.size = CHUNK_SIZE;
+  r.offset = i * CHUNK_SIZE;
+  r.write = false;
+  id = aio_submit (&r);
+  if (id < 0)
+    fail ("aio_submit of chunk %d failed", i);
+  return id;
+}
+
+void
+test_main (void)
+{
+  unsigned sync_hash, async_hash;
+  unsigned long long start;
+  int fd, i;
+
+  CHECK (create ("bench", 0), "create \"bench\"");
+  CHECK ((fd = open ("bench")) > 1, "open \"bench\"");
+  msg ("write \"bench\"");
+  random_init (0);
+  for (i = 0; i < CHUNK_CNT; i++)
+    {
+      random_bytes (buf[0], CHUNK_SIZE);
+      if (write (fd, buf[0], CHUNK_SIZE) != CHUNK_SIZE)
+        fail ("write of chunk %d failed", i);
+    }
+
+  /* Read, then process, one chunk at a time. */
+  start = ticks ();
+  seek (fd, 0);
+  sync_hash = 0;
+  for (i = 0; i < CHUNK_CNT; i++)
+    {
+      if (read (fd, buf[0], CHUNK_SIZE) != CHUNK_SIZE)
+        fail ("read of chunk %d failed", i);
+      sync_hash = process (sync_hash, buf[0], CHUNK_SIZE);
+    }
+  msg ("sync: %llu ticks", ticks () - start);
+
+  /* Keep reads in flight in the other buffers while processing
+     each chunk in order. */
+  start = ticks ();
+  {
+    int ids[CHUNK_CNT];
+    bool done[CHUNK_CNT];
+    int next = 0;
+
+    for (i = 0; i < CHUNK_CNT; i++)
+      done[i] = false;
+    for (; next < BUF_CNT && next < CHUNK_CNT; next++)
+      ids[next] = submit (fd, next, next % BUF_CNT);
+
+    async_hash = 0;
+    for (i = 0; i < CHUNK_CNT; i++)
+      {
+        while (!done[i])
+          {
+            struct aio_completion c;
+            int j;
+
+            if (!aio_wait (&c))
+              fail ("aio_wait returned false with reads outstanding");
+            for (j = 0; j < next; j++)
+              if (ids[j] == c.id)
+                break;
+            if (j == next || c.result != CHUNK_SIZE)
+              fail ("bad completion for request %d", c.id);
+            done[j] = true;
+          }
+        async_hash = process (async_hash, buf[i % BUF_CNT], CHUNK_SIZE);
+        if (next < CHUNK_CNT)
+          {
+            ids[next] = submit (fd, next, next % BUF_CNT);
+            next++;
+          }
+      }
+  }
+  msg ("async: %llu ticks", ticks () - start);
+
+  if (sync_hash != async_hash)
+    fail ("sync and async passes read different data");
+  msg ("both passes read the same data");
+
+  msg ("close \"bench\"");
+  close (fd);
+}
@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# Timings vary from run to run, so only their form is checked.
+s/^\(aio-bench\) (a?sync): \d+ ticks$/(aio-bench) $1: N ticks/
+  foreach @output;
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(aio-bench) begin
+(aio-bench) create "bench"
+(aio-bench) open "bench"
+(aio-bench) write "bench"
+(aio-bench) sync: N ticks
+(aio-bench) async: N ticks
+(aio-bench) both passes read the same data
+(aio-bench) close "bench"
+(aio-bench) end
+EOF
+pass;
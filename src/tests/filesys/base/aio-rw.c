@@ -0,0 +1,100 @@
+/* Writes a file with asynchronous requests submitted back to
+   front, then reads it back asynchronously, checking every
+   completion and that nothing more is reported afterward.
+   Finally submits an empty request, whose buffer pins no
+   pages. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK_SIZE 5000
+#define CHUNK_CNT 6
+#define FILE_SIZE (CHUNK_SIZE * CHUNK_CNT)
+
+static char buf[FILE_SIZE];
+static char rbuf[FILE_SIZE];
+
+/* Submits CHUNK_CNT requests on FD, back to front, writing BUF if
+   WRITE and otherwise reading into RBUF, and waits for them all. */
+static void
+run_requests (int fd, bool write)
+{
+  struct aio_completion c;
+  int ids[CHUNK_CNT];
+  bool done[CHUNK_CNT];
+  int i, j;
+
+  for (i = CHUNK_CNT - 1; i >= 0; i--)
+    {
+      struct aio_request r;
+
+      r.fd = fd;
+      r.buffer = (write ? buf : rbuf) + i * CHUNK_SIZE;
+      r.size = CHUNK_SIZE;
+      r.offset = i * CHUNK_SIZE;
+      r.write = write;
+      ids[i] = aio_submit (&r);
+      if (ids[i] < 0)
+        fail ("aio_submit of chunk %d failed", i);
+      done[i] = false;
+    }
+
+  for (i = 0; i < CHUNK_CNT; i++)
+    {
+      if (!aio_wait (&c))
+        fail ("aio_wait returned false with requests outstanding");
+      for (j = 0; j < CHUNK_CNT; j++)
+        if (ids[j] == c.id && !done[j])
+          break;
+      if (j == CHUNK_CNT)
+        fail ("aio_wait reported unexpected request %d", c.id);
+      if (c.result != CHUNK_SIZE)
+        fail ("chunk %d transferred %d bytes", j, c.result);
+      done[j] = true;
+    }
+
+  if (aio_poll (&c))
+    fail ("aio_poll reported request %d after all completed", c.id);
+  if (aio_wait (&c))
+    fail ("aio_wait reported request %d after all completed", c.id);
+}
+
+void
+test_main (void)
+{
+  struct aio_request r;
+  struct aio_completion c;
+  int fd, id;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+
+  msg ("write %d chunks asynchronously", CHUNK_CNT);
+  run_requests (fd, true);
+  check_file ("data", buf, sizeof buf);
+
+  msg ("read %d chunks asynchronously", CHUNK_CNT);
+  run_requests (fd, false);
+  compare_bytes (rbuf, buf, sizeof buf, 0, "data");
+
+  msg ("read 0 bytes asynchronously");
+  r.fd = fd;
+  r.buffer = rbuf + 1;
+  r.size = 0;
+  r.offset = 0;
+  r.write = false;
+  if ((id = aio_submit (&r)) < 0)
+    fail ("aio_submit of empty request failed");
+  if (!aio_wait (&c) || c.id != id)
+    fail ("aio_wait did not report empty request");
+  if (c.result != 0)
+    fail ("empty request transferred %d bytes", c.result);
+
+  msg ("close \"data\"");
+  close (fd);
+}
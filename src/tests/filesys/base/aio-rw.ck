@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(aio-rw) begin
+(aio-rw) create "data"
+(aio-rw) open "data"
+(aio-rw) write 6 chunks asynchronously
+(aio-rw) open "data" for verification
+(aio-rw) verified contents of "data"
+(aio-rw) close "data"
+(aio-rw) read 6 chunks asynchronously
+(aio-rw) read 0 bytes asynchronously
+(aio-rw) close "data"
+(aio-rw) end
+EOF
+pass;
@@ -0,0 +1,20 @@
+/* Looks up a file that does not exist, creates it, and opens it,
+   checking that the failed lookup is not remembered past the
+   create. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  const char *file_name = "latecomer";
+  int fd;
+
+  CHECK (open (file_name) == -1, "open \"%s\" (must fail)", file_name);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
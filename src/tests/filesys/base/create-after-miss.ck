@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(create-after-miss) begin
+(create-after-miss) open "latecomer" (must fail)
+(create-after-miss) create "latecomer"
+(create-after-miss) open "latecomer"
+(create-after-miss) close "latecomer"
+(create-after-miss) end
+EOF
+pass;
@@ -0,0 +1,38 @@
+/* Grows a file a piece at a time from empty, through sizes small
+   enough to be stored in its inode and past them, checking its
+   contents at each step. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[1500];
+
+/* Sizes the file reaches, in order. */
+static const size_t sizes[] = {100, 480, 496, 497, 1500};
+
+void
+test_main (void)
+{
+  const char *file_name = "tiny";
+  size_t ofs = 0;
+  size_t i;
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      size_t size = sizes[i] - ofs;
+
+      if (write (fd, buf + ofs, size) != (int) size)
+        fail ("write %zu bytes at offset %zu failed", size, ofs);
+      ofs = sizes[i];
+      msg ("grew \"%s\" to %zu bytes", file_name, ofs);
+      check_file (file_name, buf, ofs);
+    }
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
@@ -0,0 +1,32 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sm-inline) begin
+(sm-inline) create "tiny"
+(sm-inline) open "tiny"
+(sm-inline) grew "tiny" to 100 bytes
+(sm-inline) open "tiny" for verification
+(sm-inline) verified contents of "tiny"
+(sm-inline) close "tiny"
+(sm-inline) grew "tiny" to 480 bytes
+(sm-inline) open "tiny" for verification
+(sm-inline) verified contents of "tiny"
+(sm-inline) close "tiny"
+(sm-inline) grew "tiny" to 496 bytes
+(sm-inline) open "tiny" for verification
+(sm-inline) verified contents of "tiny"
+(sm-inline) close "tiny"
+(sm-inline) grew "tiny" to 497 bytes
+(sm-inline) open "tiny" for verification
+(sm-inline) verified contents of "tiny"
+(sm-inline) close "tiny"
+(sm-inline) grew "tiny" to 1500 bytes
+(sm-inline) open "tiny" for verification
+(sm-inline) verified contents of "tiny"
+(sm-inline) close "tiny"
+(sm-inline) close "tiny"
+(sm-inline) end
+EOF
+pass;
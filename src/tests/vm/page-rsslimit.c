@@ -0,0 +1,41 @@
+/* Caps the resident set at 16 pages, writes and then verifies a
+   64-page array, and checks that the process stayed within the
+   cap by replacing its own pages. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 64
+#define PAGE_SIZE 4096
+#define LIMIT 16
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  struct rusage ru;
+  int i;
+
+  CHECK (rsslimit (LIMIT) == 0, "limit resident set to %d pages", LIMIT);
+
+  msg ("write %d pages", PAGE_CNT);
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * PAGE_SIZE] = i;
+
+  msg ("verify %d pages", PAGE_CNT);
+  for (i = 0; i < PAGE_CNT; i++)
+    if (buf[i * PAGE_SIZE] != i)
+      fail ("page %d holds %d", i, buf[i * PAGE_SIZE]);
+
+  CHECK (getrusage (&ru) == 0, "getrusage");
+
+  if (ru.rss_limit != LIMIT)
+    fail ("resident set limit %lu, expected %d", ru.rss_limit, LIMIT);
+  if (ru.rss > LIMIT)
+    fail ("%lu pages resident over a limit of %d", ru.rss, LIMIT);
+  if (ru.local_evictions < PAGE_CNT - LIMIT)
+    fail ("only %lu local evictions", ru.local_evictions);
+  CHECK (rsslimit (0) == LIMIT, "restore adaptive limit");
+}
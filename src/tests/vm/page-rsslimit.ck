@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-rsslimit) begin
+(page-rsslimit) limit resident set to 16 pages
+(page-rsslimit) write 64 pages
+(page-rsslimit) verify 64 pages
+(page-rsslimit) getrusage
+(page-rsslimit) restore adaptive limit
+(page-rsslimit) end
+EOF
+pass;
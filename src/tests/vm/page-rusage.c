@@ -0,0 +1,37 @@
+/* Touches every page of a 64-page array and checks that
+   getrusage() accounts for the faults and resident pages. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 64
+#define PAGE_SIZE 4096
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  struct rusage ru;
+  int i;
+
+  msg ("touch %d pages", PAGE_CNT);
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * PAGE_SIZE] = i;
+  for (i = 0; i < PAGE_CNT; i++)
+    if (buf[i * PAGE_SIZE] != i)
+      fail ("page %d holds %d", i, buf[i * PAGE_SIZE]);
+
+  CHECK (getrusage (&ru) == 0, "getrusage");
+
+  if (ru.minor_faults + ru.major_faults < PAGE_CNT)
+    fail ("only %lu faults for %d pages",
+          ru.minor_faults + ru.major_faults, PAGE_CNT);
+  if (ru.max_rss < PAGE_CNT)
+    fail ("max resident pages %lu < %d", ru.max_rss, PAGE_CNT);
+  if (ru.rss > ru.max_rss)
+    fail ("resident pages %lu > max %lu", ru.rss, ru.max_rss);
+  if (ru.load_bytes == 0)
+    fail ("no bytes loaded from the executable");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-rusage) begin
+(page-rusage) touch 64 pages
+(page-rusage) getrusage
+(page-rusage) end
+EOF
+pass;
@@ -23,17 +23,28 @@
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
+#include "userprog/pagedir.h"
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "userprog/aio.h"
 #else
 #include "tests/threads/tests.h"
 #endif
-//#include "vm/frame.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/swap.h"
+#include "vm/zswap.h"
+#endif
 #ifdef FILESYS
 #include "devices/disk.h"
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
+#include "filesys/log.h"
 #endif
 
 
@@ -53,6 +64,7 @@ bool power_off_when_done;
 
 static void ram_init (void);
 static void paging_init (void);
+static bool cpu_has_pse (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -107,7 +119,9 @@ main (void)
 #endif
 
   /* added in project 3-1 */
-  //frame_table_init ();
+#ifdef VM
+  frame_table_init ();
+#endif
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
@@ -120,6 +134,16 @@ main (void)
   filesys_init (format_filesys);
 #endif
 
+#ifdef VM
+  swap_init ();
+  zswap_init ();
+  pageout_init ();
+#endif
+
+#ifdef USERPROG
+  aio_init ();
+#endif
+
   printf ("Boot complete.\n");
   
   /* Run actions specified on kernel command line. */
@@ -156,12 +180,19 @@ ram_init (void)
    At the time this function is called, the active page table
    (set up by loader.S) only maps the first 4 MB of RAM, so we
    should not try to use extravagant amounts of memory.
-   Fortunately, there is no need to do so. */
+   Fortunately, there is no need to do so.
+
+   If the CPU supports it, each 4 MB region that is entirely
+   backed by RAM and holds no kernel text is mapped with a single
+   4 MB page.  That saves a page table per region and lets one
+   TLB entry cover what would otherwise take 1,024.  Regions with
+   kernel text keep 4 kB pages so that the text stays read-only. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
+  bool pse = cpu_has_pse ();
   extern char _start, _end_kernel_text;
 
   pd = base_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -174,6 +205,14 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (pse && pte_idx == 0 && page + PTSPAN / PGSIZE <= ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (paddr, true);
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -183,6 +222,15 @@ paging_init (void)
       pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
     }
 
+  /* Large page directory entries are only honored once CR4.PSE
+     is set, so do that before switching page directories. */
+  if (pse)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
+    }
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
@@ -191,6 +239,20 @@ paging_init (void)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (base_page_dir)));
 }
 
+/* Returns true if the CPU supports 4 MB pages, according to the
+   PSE feature flag (bit 3 of EDX) from CPUID leaf 1.  See
+   [IA32-v2a] "CPUID--CPU Identification". */
+static bool
+cpu_has_pse (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+
+  asm volatile ("cpuid"
+                : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                : "a" (1));
+  return (edx & (1 << 3)) != 0;
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char **
@@ -252,6 +314,16 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-vmstat"))
+        rusage_on_exit = true;
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-zs"))
+        zswap_page_limit = atoi (value);
+      else if (!strcmp (name, "-pl"))
+        pageout_low = atoi (value);
+      else if (!strcmp (name, "-ph"))
+        pageout_high = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -356,6 +428,12 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -vmstat            Print VM statistics as processes exit.\n"
+#endif
+#ifdef VM
+          "  -zs=COUNT          Cache up to COUNT pages of compressed swap.\n"
+          "  -pl=COUNT          Start paging out below COUNT free user pages.\n"
+          "  -ph=COUNT          Page out until COUNT user pages are free.\n"
 #endif
           );
   power_off ();
@@ -392,12 +470,24 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  palloc_print_stats ();
 #ifdef FILESYS
   disk_print_stats ();
+  cache_print_stats ();
+  inode_print_stats ();
+  free_map_print_stats ();
+  dcache_print_stats ();
+  log_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
+  pagedir_print_stats ();
+  aio_print_stats ();
+#endif
+#ifdef VM
+  frame_print_stats ();
+  zswap_print_stats ();
 #endif
 }
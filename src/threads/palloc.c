@@ -2,14 +2,15 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -24,14 +25,26 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Besides the bitmap, every free page is on one of two lists,
+   linked through a list_elem at the start of the page itself:
+   ZEROED, for pages known to hold zeros apart from that list_elem,
+   and DIRTY, for the rest.  Single pages come off these lists in
+   O(1), and the idle thread moves pages from DIRTY to ZEROED, so
+   PAL_ZERO requests usually need no memset().
+
+   Pages are freed with interrupts off (see schedule_tail()), so
+   pool state is guarded by disabling interrupts, not by a lock. */
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+    size_t free_cnt;                    /* Number of free pages. */
+    struct list zeroed;                 /* Free pages holding zeros. */
+    struct list dirty;                  /* Other free pages. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -40,9 +53,16 @@ struct pool kernel_pool, user_pool;
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
 
+/* Statistics. */
+static long long zero_cnt;              /* PAL_ZERO pages handed out. */
+static long long prezeroed_cnt;         /* ...taken already zeroed. */
+static long long idle_zeroed_cnt;       /* Pages zeroed while idle. */
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static void *get_single (struct pool *, enum palloc_flags);
+static bool zero_one (struct pool *);
 
 /* Initializes the page allocator. */
 void
@@ -78,33 +98,84 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
   void *pages;
   size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
-
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
+  if (page_cnt == 1)
+    pages = get_single (pool, flags);
   else
-    pages = NULL;
+    {
+      old_level = intr_disable ();
+      page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+      if (page_idx != BITMAP_ERROR)
+        {
+          size_t i;
+
+          pages = pool->base + PGSIZE * page_idx;
+          for (i = 0; i < page_cnt; i++)
+            list_remove ((struct list_elem *) (pages + PGSIZE * i));
+          pool->free_cnt -= page_cnt;
+        }
+      else
+        pages = NULL;
+      intr_set_level (old_level);
 
-  if (pages != NULL) 
+      if (pages != NULL && (flags & PAL_ZERO))
+        {
+          memset (pages, 0, PGSIZE * page_cnt);
+          zero_cnt += page_cnt;
+        }
+    }
+
+  if (pages == NULL && (flags & PAL_ASSERT))
+    PANIC ("palloc_get: out of pages");
+
+  return pages;
+}
+
+/* Takes one free page from POOL, zeroed if PAL_ZERO is set in
+   FLAGS.  A zeroed page is used for PAL_ZERO if there is one;
+   otherwise dirty pages are preferred, to keep zeroed ones for
+   PAL_ZERO.  Returns a null pointer if POOL is empty. */
+static void *
+get_single (struct pool *pool, enum palloc_flags flags)
+{
+  bool want_zero = (flags & PAL_ZERO) != 0;
+  struct list *first = want_zero ? &pool->zeroed : &pool->dirty;
+  struct list *second = want_zero ? &pool->dirty : &pool->zeroed;
+  struct list *from;
+  enum intr_level old_level;
+  struct list_elem *e;
+
+  old_level = intr_disable ();
+  from = !list_empty (first) ? first : !list_empty (second) ? second : NULL;
+  if (from == NULL)
     {
-      if (flags & PAL_ZERO)
-        memset (pages, 0, PGSIZE * page_cnt);
+      intr_set_level (old_level);
+      return NULL;
     }
-  else 
+  e = list_pop_front (from);
+  bitmap_mark (pool->used_map, pg_no (e) - pg_no (pool->base));
+  pool->free_cnt--;
+  intr_set_level (old_level);
+
+  if (want_zero)
     {
-      if (flags & PAL_ASSERT)
-        PANIC ("palloc_get: out of pages");
+      zero_cnt++;
+      if (from == &pool->zeroed)
+        {
+          memset (e, 0, sizeof *e);
+          prezeroed_cnt++;
+        }
+      else
+        memset (e, 0, PGSIZE);
     }
 
-  return pages;
+  return e;
 }
 
 /* Obtains a single free page and returns its kernel virtual
@@ -125,7 +196,9 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
+  size_t i;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -144,8 +217,14 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  for (i = 0; i < page_cnt; i++)
+    list_push_back (&pool->dirty,
+                    (struct list_elem *) ((uint8_t *) pages + PGSIZE * i));
+  pool->free_cnt += page_cnt;
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -155,6 +234,72 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of free pages in the user pool if PAL_USER
+   is set in FLAGS, otherwise in the kernel pool. */
+size_t
+palloc_free_cnt (enum palloc_flags flags)
+{
+  return (flags & PAL_USER ? &user_pool : &kernel_pool)->free_cnt;
+}
+
+/* Returns the size in pages of the user pool if PAL_USER is set
+   in FLAGS, otherwise of the kernel pool. */
+size_t
+palloc_page_cnt (enum palloc_flags flags)
+{
+  return bitmap_size ((flags & PAL_USER ? &user_pool : &kernel_pool)->used_map);
+}
+
+/* Zeroes one dirty free page, preferring the user pool, and moves
+   it to its pool's zeroed list.  Called by the idle thread.
+   Returns false if there was no dirty free page. */
+bool
+palloc_zero_free_page (void)
+{
+  return zero_one (&user_pool) || zero_one (&kernel_pool);
+}
+
+/* Zeroes one dirty free page of POOL.  The page is marked in use
+   while it is being zeroed, with interrupts on, so that nobody
+   can allocate it meanwhile. */
+static bool
+zero_one (struct pool *pool)
+{
+  enum intr_level old_level;
+  struct list_elem *e;
+  size_t page_idx;
+
+  old_level = intr_disable ();
+  if (list_empty (&pool->dirty))
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  e = list_pop_front (&pool->dirty);
+  page_idx = pg_no (e) - pg_no (pool->base);
+  bitmap_mark (pool->used_map, page_idx);
+  intr_set_level (old_level);
+
+  memset (e, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  bitmap_reset (pool->used_map, page_idx);
+  list_push_back (&pool->zeroed, e);
+  idle_zeroed_cnt++;
+  intr_set_level (old_level);
+
+  return true;
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  printf ("Page allocator: %lld zeroed pages requested, %lld pre-zeroed, "
+          "%lld zeroed while idle\n",
+          zero_cnt, prezeroed_cnt, idle_zeroed_cnt);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
@@ -164,16 +309,23 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
      Calculate the space needed for the bitmap
      and subtract it from the pool's size. */
   size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  size_t i;
+
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
+  /* Initialize the pool.  Nothing is known about the contents of
+     its pages, so they all start out dirty. */
   p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
   p->base = base + bm_pages * PGSIZE;
+  p->free_cnt = page_cnt;
+  list_init (&p->zeroed);
+  list_init (&p->dirty);
+  for (i = 0; i < page_cnt; i++)
+    list_push_back (&p->dirty, (struct list_elem *) (p->base + PGSIZE * i));
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -187,3 +339,4 @@ page_from_pool (const struct pool *pool, void *page)
 
   return page_no >= start_page && page_no < end_page;
 }
+
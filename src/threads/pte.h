@@ -66,6 +66,10 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page, 0=page table (PDEs only). */
+
+/* Control Register 4 bits. */
+#define CR4_PSE 0x10            /* Page Size Extensions (4 MB pages). */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -77,9 +81,20 @@ static inline uint32_t pde_create (uint32_t *pt) {
    PDE, which must "present", points to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
   ASSERT (pde & PTE_P);
+  ASSERT (!(pde & PTE_PS));
   return ptov (pde & PTE_ADDR);
 }
 
+/* Returns a PDE that maps the 4 MB of physical memory starting
+   at PADDR, which must be 4 MB aligned, as a single large page.
+   The page will be usable only by ring 0 code (the kernel).
+   Requires CR4_PSE to be set.  See [IA32-v3a] 3.7.3 "Mixing
+   4-KByte and 4-MByte Pages". */
+static inline uint32_t pde_create_large (uintptr_t paddr, bool writable) {
+  ASSERT ((paddr & (PTSPAN - 1)) == 0);
+  return paddr | PTE_PS | PTE_P | (writable ? PTE_W : 0);
+}
+
 /* Returns a PTE that points to PAGE.
    The PTE's page is readable.
    If WRITABLE is true then it will be writable as well.
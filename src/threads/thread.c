@@ -10,6 +10,7 @@
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -186,6 +187,11 @@ thread_create (const char *name, int priority,
 
   page_table_init (&(t->page_table));
 
+  /* A fixed resident set limit is inherited across exec. */
+  t->rss_limit = thread_current ()->rss_limit;
+  t->rusage.rss_limit = t->rss_limit != 0 ? t->rss_limit : RSS_MIN_PAGES;
+  t->start_tick = timer_ticks ();
+
   list_push_back(&thread_current()->child_list, &(t->child_elem));
 
   /* Stack frame for kernel_thread(). */
@@ -417,6 +423,11 @@ idle (void *idle_started_ UNUSED)
 
   for (;;) 
     {
+      /* Zero free pages until some other thread is ready, so that
+         PAL_ZERO allocations find them already zeroed. */
+      while (list_empty (&ready_list) && palloc_zero_free_page ())
+        continue;
+
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
@@ -499,6 +510,9 @@ init_thread (struct thread *t, const char *name, int priority)
   sema_init(&(t->end_sema), 0);
   sema_init(&(t->wait_sema), 0);
 
+  lock_init(&(t->page_table_lock));
+  vm_area_map_init(&(t->vm_areas));
+
   t->next_fd = 2;
   t->load_result = false;
   t->f = NULL;
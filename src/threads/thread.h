@@ -6,6 +6,8 @@
 #include <stdint.h>
 #include "threads/synch.h"
 #include <hash.h>
+#include <rusage.h>
+#include "vm/area.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -115,10 +117,20 @@ struct thread
     struct semaphore wait_sema;
 
     struct file *f;
+    struct aio_queue *aio;		/* Asynchronous I/O, or NULL */
 
     /* added in VM */
     struct hash page_table;		/* Hash for page_table */
-
+    struct lock page_table_lock;	/* Guards page_table. */
+    struct vm_area_map vm_areas;	/* Areas of the address space */
+    struct rusage rusage;		/* VM statistics */
+    size_t rss_limit;			/* Fixed resident set limit, or 0 */
+    int64_t fault_tick;			/* Tick of the last page fault */
+    int pageout_cnt;			/* Frames being written to swap */
+    int64_t start_tick;			/* Tick the thread was created */
+
+    /* added in FILESYS */
+    int log_depth;			/* Nesting of file system transactions */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
@@ -0,0 +1,328 @@
+#include "userprog/aio.h"
+#include <debug.h>
+#include <list.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+
+/* Asynchronous file I/O.
+
+   aio_submit() pins the pages of the request's user buffer in
+   the submitting process, where page_pin() must run, and queues
+   the request for one of WORKER_CNT kernel threads.  The worker
+   reads or writes the file straight through the pinned frames,
+   then moves the request onto its process's completion queue.
+   The process reaps completions with aio_reap(), which unpins
+   the buffer.  A process that exits first waits for its requests
+   to finish before its pages go away.
+
+   Each request reopens its file, so closing the descriptor while
+   the request is in flight is harmless. */
+
+/* Number of I/O worker threads. */
+#define WORKER_CNT 4
+
+/* Pages a request's buffer may span. */
+#define PAGES_MAX (AIO_MAX_SIZE / PGSIZE + 1)
+
+/* A process's asynchronous I/O state. */
+struct aio_queue
+  {
+    struct lock lock;                   /* Guards the members below. */
+    struct condition completed;         /* Signaled when DONE grows. */
+    struct list done;                   /* Completed, not yet reaped. */
+    int in_flight;                      /* Submitted, not yet completed. */
+    int pending;                        /* Submitted, not yet reaped. */
+    int next_id;                        /* Identifier for next request. */
+  };
+
+/* An asynchronous request. */
+struct aio_op
+  {
+    struct list_elem elem;              /* In OPS, then in QUEUE's DONE. */
+    struct aio_queue *queue;            /* Submitter's queue. */
+    int id;                             /* Identifier for submitter. */
+    struct file *file;                  /* File to read or write. */
+    bool write;                         /* Write the buffer to FILE? */
+    off_t offset;                       /* File offset. */
+    uint8_t *uaddr;                     /* User buffer. */
+    size_t size;                        /* Size of buffer. */
+    void *kaddrs[PAGES_MAX];            /* Pinned kernel address of each
+                                           page-sized chunk of buffer. */
+    size_t pinned_cnt;                  /* Number of KADDRS pinned. */
+    int result;                         /* Bytes transferred. */
+  };
+
+/* Requests waiting for a worker. */
+static struct list ops;
+static struct lock ops_lock;
+static struct condition ops_ready;
+
+/* Statistics. */
+static long long submit_cnt;            /* Requests submitted. */
+static long long byte_cnt;              /* Bytes transferred. */
+static int in_flight_cnt;               /* Requests in flight now. */
+static int in_flight_max;               /* Most requests in flight. */
+
+static thread_func worker;
+
+/* Initializes asynchronous I/O and starts the workers. */
+void
+aio_init (void)
+{
+  int i;
+
+  list_init (&ops);
+  lock_init (&ops_lock);
+  cond_init (&ops_ready);
+
+  for (i = 0; i < WORKER_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "aio-%d", i);
+      thread_create (name, PRI_DEFAULT, worker, NULL);
+    }
+}
+
+/* Returns the size of the chunk of OP's buffer that starts at user
+   address UADDR: the rest of its page, or of the buffer. */
+static size_t
+chunk_size (const struct aio_op *op, const uint8_t *uaddr)
+{
+  size_t left = op->uaddr + op->size - uaddr;
+  size_t size = PGSIZE - pg_ofs (uaddr);
+
+  return size < left ? size : left;
+}
+
+/* Unpins the first CNT chunks of OP's buffer. */
+static void
+unpin (struct aio_op *op, size_t cnt)
+{
+  uint8_t *uaddr = op->uaddr;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      page_unpin (uaddr, !op->write);
+      uaddr += chunk_size (op, uaddr);
+    }
+}
+
+/* Submits the asynchronous request R on behalf of the current
+   process.  Returns an identifier for the request, which will be
+   reported when it completes, or -1 if R's descriptor is not an
+   open file, R is larger than AIO_MAX_SIZE, R would reach past the
+   largest file offset, R's buffer cannot be pinned, or the process
+   already has AIO_MAX_PENDING requests. */
+int
+aio_submit (const struct aio_request *r)
+{
+  struct thread *t = thread_current ();
+  struct aio_queue *q = t->aio;
+  struct file *file;
+  struct aio_op *op;
+  uint8_t *uaddr;
+  size_t i;
+
+  file = get_file (r->fd);
+  if (file == NULL || r->size > AIO_MAX_SIZE || r->offset > INT32_MAX
+      || r->size > INT32_MAX - r->offset)
+    return -1;
+
+  if (q == NULL)
+    {
+      q = t->aio = malloc (sizeof *q);
+      if (q == NULL)
+        return -1;
+      lock_init (&q->lock);
+      cond_init (&q->completed);
+      list_init (&q->done);
+      q->in_flight = q->pending = 0;
+      q->next_id = 0;
+    }
+  if (q->pending >= AIO_MAX_PENDING)
+    return -1;
+
+  op = malloc (sizeof *op);
+  if (op == NULL)
+    return -1;
+  op->queue = q;
+  op->write = r->write;
+  op->offset = r->offset;
+  op->uaddr = r->buffer;
+  op->size = r->size;
+  op->result = 0;
+
+  /* Pin the buffer, which the worker cannot fault in. */
+  for (i = 0, uaddr = op->uaddr; uaddr < op->uaddr + op->size; i++)
+    {
+      op->kaddrs[i] = page_pin (uaddr, !op->write);
+      if (op->kaddrs[i] == NULL)
+        {
+          unpin (op, i);
+          free (op);
+          return -1;
+        }
+      uaddr += chunk_size (op, uaddr);
+    }
+  op->pinned_cnt = i;
+
+  op->file = file_reopen (file);
+  if (op->file == NULL)
+    {
+      unpin (op, i);
+      free (op);
+      return -1;
+    }
+
+  lock_acquire (&q->lock);
+  op->id = q->next_id++;
+  q->in_flight++;
+  q->pending++;
+  lock_release (&q->lock);
+
+  lock_acquire (&ops_lock);
+  list_push_back (&ops, &op->elem);
+  submit_cnt++;
+  if (++in_flight_cnt > in_flight_max)
+    in_flight_max = in_flight_cnt;
+  cond_signal (&ops_ready, &ops_lock);
+  lock_release (&ops_lock);
+
+  return op->id;
+}
+
+/* Carries out OP. */
+static void
+run (struct aio_op *op)
+{
+  uint8_t *uaddr = op->uaddr;
+  size_t i;
+
+  for (i = 0; uaddr < op->uaddr + op->size; i++)
+    {
+      size_t size = chunk_size (op, uaddr);
+      off_t n;
+
+      if (op->write)
+        n = file_write_at (op->file, op->kaddrs[i], size, op->offset);
+      else
+        n = file_read_at (op->file, op->kaddrs[i], size, op->offset);
+
+      op->result += n;
+      op->offset += n;
+      if ((size_t) n < size)
+        break;
+      uaddr += size;
+    }
+}
+
+/* I/O worker thread.  Carries out queued requests and completes
+   them. */
+static void
+worker (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct aio_op *op;
+      struct aio_queue *q;
+
+      lock_acquire (&ops_lock);
+      while (list_empty (&ops))
+        cond_wait (&ops_ready, &ops_lock);
+      op = list_entry (list_pop_front (&ops), struct aio_op, elem);
+      lock_release (&ops_lock);
+
+      run (op);
+
+      lock_acquire (&ops_lock);
+      byte_cnt += op->result;
+      in_flight_cnt--;
+      lock_release (&ops_lock);
+
+      q = op->queue;
+      lock_acquire (&q->lock);
+      list_push_back (&q->done, &op->elem);
+      q->in_flight--;
+      cond_broadcast (&q->completed, &q->lock);
+      lock_release (&q->lock);
+    }
+}
+
+/* Releases completed request OP.  Must be called by the process
+   that submitted it. */
+static void
+release (struct aio_op *op)
+{
+  unpin (op, op->pinned_cnt);
+  file_close (op->file);
+  free (op);
+}
+
+/* Reports one of the current process's completed requests into
+   *C and releases it.  If none has completed and WAIT is true,
+   waits for one, unless none is in flight.  Returns true if a
+   completion was reported. */
+bool
+aio_reap (struct aio_completion *c, bool wait)
+{
+  struct aio_queue *q = thread_current ()->aio;
+  struct aio_op *op;
+
+  if (q == NULL)
+    return false;
+
+  lock_acquire (&q->lock);
+  while (list_empty (&q->done) && wait && q->in_flight > 0)
+    cond_wait (&q->completed, &q->lock);
+  if (list_empty (&q->done))
+    {
+      lock_release (&q->lock);
+      return false;
+    }
+  op = list_entry (list_pop_front (&q->done), struct aio_op, elem);
+  q->pending--;
+  lock_release (&q->lock);
+
+  c->id = op->id;
+  c->result = op->result;
+  release (op);
+  return true;
+}
+
+/* Waits for the current process's requests to complete and
+   releases them, for a process that is exiting. */
+void
+aio_exit (void)
+{
+  struct thread *t = thread_current ();
+  struct aio_queue *q = t->aio;
+
+  if (q == NULL)
+    return;
+
+  lock_acquire (&q->lock);
+  while (q->in_flight > 0)
+    cond_wait (&q->completed, &q->lock);
+  lock_release (&q->lock);
+
+  while (!list_empty (&q->done))
+    release (list_entry (list_pop_front (&q->done), struct aio_op, elem));
+  free (q);
+  t->aio = NULL;
+}
+
+/* Prints asynchronous I/O statistics. */
+void
+aio_print_stats (void)
+{
+  printf ("Async I/O: %lld requests, %lld bytes, %d most in flight\n",
+          submit_cnt, byte_cnt, in_flight_max);
+}
@@ -0,0 +1,13 @@
+#ifndef USERPROG_AIO_H
+#define USERPROG_AIO_H
+
+#include <aio.h>
+#include <stdbool.h>
+
+void aio_init (void);
+int aio_submit (const struct aio_request *);
+bool aio_reap (struct aio_completion *, bool wait);
+void aio_exit (void);
+void aio_print_stats (void);
+
+#endif /* userprog/aio.h */
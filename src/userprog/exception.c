@@ -4,6 +4,7 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "userprog/syscall.h"
 #include "userprog/process.h"
 #include "vm/page.h"
@@ -153,18 +154,20 @@ page_fault (struct intr_frame *f)
 
 
   /* added in project 3-1 */
-  if (!not_present)
-    sys_exit (-1);
+  if (not_present && page_load (fault_addr))
+    return;
 
-  struct page_table_entry *pte;
-
-  pte = get_pte_by_vaddr (fault_addr);
-
-  if (pte == NULL)
-    sys_exit (-1);
+  /* A bad user address touched by get_user() or put_user() in
+     syscall.c: resume at the address they left in eax, with -1
+     in eax to report the failure. */
+  if (!user && is_user_vaddr (fault_addr))
+    {
+      f->eip = (void (*) (void)) f->eax;
+      f->eax = 0xffffffff;
+      return;
+    }
 
-  if (!load_pte (pte))
-    sys_exit (-1); 
+  sys_exit (-1);
 
 
   /*
@@ -1,6 +1,7 @@
 #include "userprog/pagedir.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
 #include "threads/pte.h"
@@ -8,6 +9,15 @@
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
+
+/* TLB statistics.  A "full flush avoided" is a TLB invalidation
+   of the active page directory that used to reload CR3 and now
+   does not. */
+static long long invlpg_cnt;    /* # of single-page invalidations. */
+static long long flush_cnt;     /* # of CR3 reloads for batches. */
+static long long avoided_cnt;   /* # of full flushes avoided. */
+static long long skipped_cnt;   /* # skipped, page directory inactive. */
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -34,7 +44,7 @@ pagedir_destroy (uint32_t *pd)
 
   ASSERT (pd != base_page_dir);
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
+    if ((*pde & PTE_P) && !(*pde & PTE_PS)) 
       {
         uint32_t *pt = pde_get_pt (*pde);
         uint32_t *pte;
@@ -52,7 +62,8 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.
+   Also returns a null pointer if VADDR falls in a 4 MB page. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -80,6 +91,10 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
         return NULL;
     }
 
+  /* A 4 MB page of the kernel mapping has no page table to walk. */
+  if (*pde & PTE_PS)
+    return NULL;
+
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
   return &pt[pt_no (vaddr)];
@@ -152,7 +167,95 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
+    }
+}
+
+/* Starts a batch of page table changes to PD. */
+void
+tlb_gather_init (struct tlb_gather *tlb, uint32_t *pd)
+{
+  tlb->pd = pd;
+  tlb->cnt = 0;
+  tlb->free_pages = NULL;
+}
+
+/* Marks user virtual page UPAGE "not present" in TLB's page
+   directory, as pagedir_clear_page() does, but leaves the TLB
+   invalidation to tlb_gather_finish().  Until then, the CPU may
+   still use a stale translation for UPAGE, so the caller must
+   not touch UPAGE through this page directory in the meantime. */
+void
+pagedir_clear_page_batched (struct tlb_gather *tlb, void *upage)
+{
+  uint32_t *pte;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  pte = lookup_page (tlb->pd, upage, false);
+  if (pte != NULL && (*pte & PTE_P) != 0)
+    {
+      *pte &= ~PTE_P;
+      if (tlb->cnt < TLB_GATHER_MAX)
+        tlb->pages[tlb->cnt] = upage;
+      tlb->cnt++;
+    }
+}
+
+/* Frees KPAGE, a frame that was mapped through TLB's page
+   directory, once tlb_gather_finish() has flushed any stale
+   translation for it.  Freeing it sooner would let it be
+   reallocated while the TLB still maps it. */
+void
+tlb_gather_free_page (struct tlb_gather *tlb, void *kpage)
+{
+  *(void **) kpage = tlb->free_pages;
+  tlb->free_pages = kpage;
+}
+
+/* Brings the TLB up to date with the pages cleared in TLB: with
+   invlpg for each page if there were few, with a single CR3
+   reload if there were many, and not at all if the page
+   directory is not the active one. */
+static void
+flush_gathered (struct tlb_gather *tlb)
+{
+  if (tlb->cnt == 0)
+    return;
+
+  if (active_pd () != tlb->pd)
+    skipped_cnt += tlb->cnt;
+  else if (tlb->cnt <= TLB_GATHER_MAX)
+    {
+      size_t i;
+
+      for (i = 0; i < tlb->cnt; i++)
+        asm volatile ("invlpg (%0)" : : "r" (tlb->pages[i]) : "memory");
+      invlpg_cnt += tlb->cnt;
+      avoided_cnt += tlb->cnt;
+    }
+  else
+    {
+      invalidate_pagedir (tlb->pd);
+      flush_cnt++;
+      avoided_cnt += tlb->cnt - 1;
+    }
+  tlb->cnt = 0;
+}
+
+/* Ends a batch of page table changes, bringing the TLB up to
+   date and then freeing the frames passed to
+   tlb_gather_free_page(). */
+void
+tlb_gather_finish (struct tlb_gather *tlb)
+{
+  flush_gathered (tlb);
+  while (tlb->free_pages != NULL)
+    {
+      void *kpage = tlb->free_pages;
+      tlb->free_pages = *(void **) kpage;
+      palloc_free_page (kpage);
     }
 }
 
@@ -180,7 +283,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -209,7 +312,7 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -261,3 +364,27 @@ invalidate_pagedir (uint32_t *pd)
       pagedir_activate (pd);
     } 
 }
+
+/* Invalidates the TLB entry for VADDR if PD is the active page
+   directory, without flushing the rest of the TLB.  See
+   [IA32-v2a] "INVLPG--Invalidate TLB Entry". */
+static void
+invalidate_page (uint32_t *pd, const void *vaddr)
+{
+  if (active_pd () == pd)
+    {
+      asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+      invlpg_cnt++;
+      avoided_cnt++;
+    }
+  else
+    skipped_cnt++;
+}
+
+/* Prints TLB statistics. */
+void
+pagedir_print_stats (void)
+{
+  printf ("TLB: %lld invlpg, %lld full flushes, %lld full flushes avoided, "
+          "%lld skipped\n", invlpg_cnt, flush_cnt, avoided_cnt, skipped_cnt);
+}
@@ -2,8 +2,28 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* Largest number of pages invalidated one at a time with invlpg
+   by a TLB gather.  Past this, reloading CR3 is cheaper. */
+#define TLB_GATHER_MAX 32
+
+/* Batches the TLB invalidations for a run of page table changes
+   to a single page directory, so that they cost at most one
+   flush.  Use tlb_gather_init(), then any number of
+   pagedir_clear_page_batched() and tlb_gather_free_page() calls,
+   then tlb_gather_finish(). */
+struct tlb_gather
+  {
+    uint32_t *pd;                       /* Page directory being changed. */
+    size_t cnt;                         /* Pages cleared so far. */
+    void *pages[TLB_GATHER_MAX];        /* The first TLB_GATHER_MAX. */
+    void *free_pages;                   /* Frames to free after the flush,
+                                           linked through their first
+                                           word. */
+  };
+
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
@@ -14,5 +34,11 @@ void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 void pagedir_activate (uint32_t *pd);
+void pagedir_print_stats (void);
+
+void tlb_gather_init (struct tlb_gather *, uint32_t *pd);
+void pagedir_clear_page_batched (struct tlb_gather *, void *upage);
+void tlb_gather_free_page (struct tlb_gather *, void *kpage);
+void tlb_gather_finish (struct tlb_gather *);
 
 #endif /* userprog/pagedir.h */
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/aio.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
@@ -144,10 +145,13 @@ process_exit (void)
   struct thread *curr = thread_current ();
   uint32_t *pd;
 
-  file_close(curr->f);
+  /* Asynchronous requests may still be using our pages. */
+  aio_exit ();
 
   page_table_destroy (&(curr->page_table));
 
+  file_close(curr->f);
+
   //printf("(process_exit) caller : %s, status : %08x\n", curr->name, curr->status);
 
   /* Destroy the current process's page directory and switch back
@@ -257,10 +261,6 @@ static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           bool writable);
 
 
-/* lock for file(from syscall.c) */
-extern struct lock filesys_lock;
-
-
 /* Loads an ELF executable from FILE_NAME into the current thread.
    Stores the executable's entry point into *EIP
    and its initial stack pointer into *ESP.
@@ -284,21 +284,17 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
   token = strtok_r((char *)file_name, " ", &save_ptr);
 
-  lock_acquire(&filesys_lock);
-
   /* Open executable file. */
   file = filesys_open (token);
 
   if (file == NULL) 
     {
-      lock_release(&filesys_lock);
       printf ("load: %s: open failed\n", token);
       goto done; 
     }
 
   t->f = file;
   file_deny_write(file);
-  lock_release(&filesys_lock);
 
   /* Read and verify executable header. */
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
@@ -398,8 +394,6 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
 /* load() helpers. */
 
-static bool install_page (void *upage, void *kpage, bool writable);
-
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
 static bool
@@ -467,63 +461,28 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  file_seek (file, ofs);
-  while (read_bytes > 0 || zero_bytes > 0) 
-    {
-      /* Do calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-      /* Get a page of memory. */
-//      uint8_t *kpage = palloc_get_page (PAL_USER);
-//      if (kpage == NULL)
-//        return false;
-
-      struct page_table_entry *pte = (struct page_table_entry *)malloc (sizeof (struct page_table_entry));
-
-      if (pte == NULL)
-        return false;
-
-      /* Load this page. */
-//      if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
-//        {
-//          palloc_free_page (kpage);
-//          return false; 
-//        }
-//      memset (kpage + page_read_bytes, 0, page_zero_bytes);
-
-      /* Add the page to the process's address space. */
-//      if (!install_page (upage, kpage, writable)) 
-//        {
-//          palloc_free_page (kpage);
-//          return false; 
-//        }
-
-      pte->type = VM_BIN;
-      pte->f = file;
-      pte->vaddr = upage;
-      pte->ofs = ofs;
-      pte->read_bytes = page_read_bytes;
-      pte->zero_bytes = page_zero_bytes;
-      pte->writable = writable;
-
-      pte_insert(&(thread_current ()->page_table), pte);
-
-      load_pte(pte);
-
- 
- 
-      /* Advance. */
-      read_bytes -= page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-      upage += PGSIZE;
-      ofs += page_read_bytes;
-    }
+  /* Pages are loaded on first touch, so the whole segment is a
+     single area. */
+  struct vm_area *vma = (struct vm_area *)malloc (sizeof (struct vm_area));
+
+  if (vma == NULL)
+    return false;
+
+  vma->type = VM_BIN;
+  vma->start = upage;
+  vma->end = upage + read_bytes + zero_bytes;
+  vma->f = file;
+  vma->ofs = ofs;
+  vma->read_bytes = read_bytes;
+  vma->writable = writable;
+
+  if (!vm_area_insert (&(thread_current ()->vm_areas), vma))
+  {
+    free (vma);
+    return false;
+  }
 
   return true;
- 
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -531,65 +490,35 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp) 
 {
-  uint8_t *kpage, *upage;
-  bool success = false;
+  struct vm_area *vma;
+  uint8_t *upage;
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   upage = ((uint8_t *)PHYS_BASE) - PGSIZE;
 
-  if (kpage != NULL)
-    {
-      success = install_page (upage, kpage, true);
-
-      if (success)
-      {
-        struct page_table_entry *pte;
-	pte = (struct page_table_entry *)malloc (sizeof (struct page_table_entry));
-
-	if (pte == NULL)
-	{
-	  success = false;
-	  palloc_free_page (kpage);
-	}
-	else
-	{
-          *esp = PHYS_BASE;
-
-	  memset (pte, 0, sizeof (struct page_table_entry));
-
-	  pte->type = VM_ANON;
-	  pte->vaddr = upage;
-	  pte->writable = true;
-	  pte->loaded = true;
-
-          pte_insert (&(thread_current ()->page_table), pte);
-	}
-      }
-      else
-        palloc_free_page (kpage);
-    }
+  vma = (struct vm_area *)malloc (sizeof (struct vm_area));
 
-  return success;
-}
+  if (vma == NULL)
+    return false;
 
-/* Adds a mapping from user virtual address UPAGE to kernel
-   virtual address KPAGE to the page table.
-   If WRITABLE is true, the user process may modify the page;
-   otherwise, it is read-only.
-   UPAGE must not already be mapped.
-   KPAGE should probably be a page obtained from the user pool
-   with palloc_get_page().
-   Returns true on success, false if UPAGE is already mapped or
-   if memory allocation fails. */
-static bool
-install_page (void *upage, void *kpage, bool writable)
-{
-  struct thread *t = thread_current ();
+  memset (vma, 0, sizeof (struct vm_area));
+
+  vma->type = VM_ANON;
+  vma->start = upage;
+  vma->end = PHYS_BASE;
+  vma->writable = true;
+
+  if (!vm_area_insert (&(thread_current ()->vm_areas), vma))
+  {
+    free (vma);
+    return false;
+  }
 
-  /* Verify that there's not already a page at that virtual
-     address, then map our page there. */
-  return (pagedir_get_page (t->pagedir, upage) == NULL
-          && pagedir_set_page (t->pagedir, upage, kpage, writable));
+  if (!page_load (upage))
+    return false;
+
+  *esp = PHYS_BASE;
+
+  return true;
 }
 
 void push_arguments (char *file_name, char *save_ptr, void **esp)
@@ -750,24 +679,3 @@ void remove_file(int fd)
   }
 }
 
-bool load_pte (struct page_table_entry *pte)
-{
-  void *kpage;
-
-  if (pte->type != VM_BIN)
-    return false;
-
-  kpage = palloc_get_page (PAL_USER);
-
-  if (kpage == NULL)
-    return false;
-
-  if (!load_page (pte, kpage) || !install_page (pte->vaddr, kpage, pte->writable))
-  {
-    palloc_free_page (kpage);
-
-    return false;
-  }
-
-  return true;
-}
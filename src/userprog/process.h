@@ -22,6 +22,5 @@ struct file_struct {
   struct list_elem elem;
 };
 
-bool load_pte (struct page_table_entry *);
 
 #endif /* userprog/process.h */
@@ -7,17 +7,24 @@
 #include "userprog/pagedir.h"
 #include "filesys/filesys.h"
 #include "userprog/process.h"
+#include "userprog/aio.h"
 #include "devices/input.h"
+#include "devices/timer.h"
 #include "threads/vaddr.h"
+#include "threads/palloc.h"
 #include "vm/page.h"
+#include <string.h>
 
 
 static void syscall_handler (struct intr_frame *);
 
-static bool is_valid_ptr(const void *vaddr);
-static void check_usable_ptr(const void *vaddr);
+static int get_user(const uint8_t *uaddr);
+static bool put_user(uint8_t *udst, uint8_t byte);
+static bool copy_from_user(void *dst, const void *usrc, size_t size);
+static bool copy_to_user(void *udst, const void *src, size_t size);
+static char *copy_in_string(const char *us);
+static void check_user_buffer(const void *ubuf, unsigned size, bool write);
 static void get_args(struct intr_frame *f, int *args, int num);
-static int user_to_kernel_address(const void *);
 
 /* implemented in project2 */
 static void sys_halt(void);
@@ -33,31 +40,64 @@ static void sys_seek(int fd, unsigned position);
 static unsigned sys_tell(int fd);
 static void sys_close(int fd);
 
-struct lock filesys_lock;
+/* extensions */
+static int sys_getrusage(struct rusage *usage);
+static int sys_rsslimit(int pages);
+static int sys_aio_submit(const struct aio_request *request);
+static bool sys_aio_reap(struct aio_completion *completion, bool wait);
+static long long fault_rate(struct thread *t);
+
+/* -vmstat: print VM statistics when a process exits? */
+bool rusage_on_exit;
 
 
 void
 syscall_init (void) 
 {
-  lock_init(&filesys_lock);
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
 static void
 syscall_handler (struct intr_frame *f UNUSED) 
 {
-  check_usable_ptr((const void *)f->esp);
+  int syscall_number;
+
+  if(!copy_from_user(&syscall_number, f->esp, sizeof syscall_number))
+    sys_exit(-1);
 
-  int syscall_number = *(int *)(f->esp);
-  int num_of_args[13] = {0, 1, 1, 1, 2, 1, 1, 1, 3, 3, 2, 1, 1};
+  int num_of_args[SYS_AIO_WAIT + 1] = {0, 1, 1, 1, 2, 1, 1, 1, 3, 3, 2, 1, 1,
+                                       2, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1};
   int args[3];
 
+  if(syscall_number < SYS_HALT || syscall_number > SYS_AIO_WAIT)
+    sys_exit(-1);
+
   //printf ("(system call) sysnum : %d\n", syscall_number);
 
   if(syscall_number != SYS_HALT)
     get_args(f, &args[0], num_of_args[syscall_number]);
 
 
+  /* String arguments are copied into the kernel; buffers are
+     checked here and then accessed in place. */
+  char *kstr = NULL;
+
+  switch(syscall_number)
+  {
+    case SYS_EXEC:
+    case SYS_CREATE:
+    case SYS_REMOVE:
+    case SYS_OPEN:
+	    kstr = copy_in_string((const char *)args[0]);
+	    break;
+    case SYS_READ:
+	    check_user_buffer((const void *)args[1], (unsigned)args[2], true);
+	    break;
+    case SYS_WRITE:
+	    check_user_buffer((const void *)args[1], (unsigned)args[2], false);
+	    break;
+  }
+
   switch(syscall_number)
   {
     case SYS_HALT: //0
@@ -67,28 +107,28 @@ syscall_handler (struct intr_frame *f UNUSED)
 	    sys_exit(args[0]);
 	    break;
     case SYS_EXEC: //2
-	    f->eax = sys_exec((const char *)user_to_kernel_address((const void *)args[0]));
+	    f->eax = sys_exec(kstr);
 	    break;
     case SYS_WAIT: //3
 	    f->eax = sys_wait(args[0]);
 	    break;
     case SYS_CREATE: //4
-	    f->eax = sys_create((const char *)user_to_kernel_address((const void *)args[0]), (unsigned)args[1]);
+	    f->eax = sys_create(kstr, (unsigned)args[1]);
 	    break;
     case SYS_REMOVE: //5
-	    f->eax = sys_remove((const char *)user_to_kernel_address((const void *)args[0]));
+	    f->eax = sys_remove(kstr);
 	    break;
     case SYS_OPEN: //6
-	    f->eax = sys_open((const char *)user_to_kernel_address((const void *)args[0]));
+	    f->eax = sys_open(kstr);
 	    break;
     case SYS_FILESIZE: //7
 	    f->eax = sys_filesize(args[0]);
 	    break;
     case SYS_READ: //8
-	    f->eax = sys_read(args[0], (void *)user_to_kernel_address((const void *)args[1]), (unsigned)args[2]);
+	    f->eax = sys_read(args[0], (void *)args[1], (unsigned)args[2]);
 	    break;
     case SYS_WRITE: //9
-	    f->eax = sys_write(args[0], (const void *)user_to_kernel_address((const void *)args[1]), (unsigned)args[2]);
+	    f->eax = sys_write(args[0], (const void *)args[1], (unsigned)args[2]);
 	    break;
     case SYS_SEEK: //10
 	    sys_seek(args[0], (unsigned)args[1]);
@@ -99,10 +139,28 @@ syscall_handler (struct intr_frame *f UNUSED)
     case SYS_CLOSE: //12
 	    sys_close(args[0]);
 	    break;
+    case SYS_GETRUSAGE: //20
+	    f->eax = sys_getrusage((struct rusage *)args[0]);
+	    break;
+    case SYS_RSSLIMIT: //21
+	    f->eax = sys_rsslimit(args[0]);
+	    break;
+    case SYS_AIO_SUBMIT: //22
+	    f->eax = sys_aio_submit((const struct aio_request *)args[0]);
+	    break;
+    case SYS_AIO_POLL: //23
+	    f->eax = sys_aio_reap((struct aio_completion *)args[0], false);
+	    break;
+    case SYS_AIO_WAIT: //24
+	    f->eax = sys_aio_reap((struct aio_completion *)args[0], true);
+	    break;
     default:
 	    printf("Undefined system call!\n");
 	    break;
   }
+
+  if(kstr != NULL)
+    palloc_free_page(kstr);
 }
 
 static void sys_halt(void)
@@ -128,6 +186,20 @@ void sys_exit(int status)
 
   printf("%s: exit(%d)\n", t->name, status);
 
+  if(rusage_on_exit)
+  {
+    struct rusage *ru = &(t->rusage);
+
+    printf("%s: %lu minor faults, %lu major faults, %lu evictions, "
+           "%lu swap-ins, %lu swap-outs, %lu max resident pages, "
+           "%llu bytes loaded\n", t->name, ru->minor_faults,
+           ru->major_faults, ru->evictions, ru->swap_ins, ru->swap_outs,
+           ru->max_rss, ru->load_bytes);
+    printf("%s: resident set limit %lu pages, %lu local evictions, "
+           "%lld faults per second\n", t->name, ru->rss_limit,
+           ru->local_evictions, fault_rate(t));
+  }
+
   thread_exit();
 }
 
@@ -159,60 +231,32 @@ static int sys_wait (int pid)
 
 static bool sys_create(const char *file, unsigned initial_size)
 {
-  lock_acquire(&filesys_lock);
-  bool result = filesys_create(file, initial_size);
-  lock_release(&filesys_lock);
-
-  return result;
+  return filesys_create(file, initial_size);
 }
 
 static bool sys_remove(const char *file)
 {
-  lock_acquire(&filesys_lock);
-  bool result = filesys_remove(file);
-  lock_release(&filesys_lock);
- 
-  return result;
+  return filesys_remove(file);
 }
 
 static int sys_open(const char *file)
 {
-  lock_acquire(&filesys_lock); 
-
   struct file *f = filesys_open(file);
 
   if(f == NULL)
-  {
-    lock_release(&filesys_lock);
-
     return -1;
-  }
-
-  int fd = add_file(f);
 
-  lock_release(&filesys_lock);
-
-  return fd;
+  return add_file(f);
 }
 
 static int sys_filesize(int fd)
 {
-  lock_acquire(&filesys_lock);
- 
   struct file *f = get_file(fd);
 
   if(f == NULL)
-  {
-    lock_release(&filesys_lock);
-
     return -1;
-  }
-
-  int size = file_length(f);
-
-  lock_release(&filesys_lock);	
 
-  return size;
+  return file_length(f);
 }
 
 static int sys_read(int fd, void *buffer, unsigned size)
@@ -232,20 +276,26 @@ static int sys_read(int fd, void *buffer, unsigned size)
     return size;
   }
 
-  lock_acquire(&filesys_lock);
- 
   struct file *f = get_file(fd);
 
   if(f == NULL)
-  {
-    lock_release(&filesys_lock);
-
     return -1;
-  }
 
-  int bytes = file_read(f, buffer, size);
+  /* Read straight into the user's frames, one pinned page at a
+     time. */
+  struct user_buffer ub;
+  int bytes = 0;
+
+  user_buffer_init(&ub, buffer, size, true);
+  while(user_buffer_next(&ub))
+  {
+    int n = file_read(f, ub.kaddr, ub.size);
 
-  lock_release(&filesys_lock);
+    bytes += n;
+    if((size_t)n < ub.size)
+      break;
+  }
+  user_buffer_finish(&ub);
 
   return bytes;
 }
@@ -255,128 +305,263 @@ static int sys_write(int fd, const void *buffer, unsigned size)
   if(buffer == NULL)
     sys_exit(-1);
 
-  
+  struct user_buffer ub;
+  int bytes = 0;
+
   if(fd == STDOUT_FILENO)
   {
-    putbuf(buffer, size);
-
-    return size;
+    user_buffer_init(&ub, (void *)buffer, size, false);
+    while(user_buffer_next(&ub))
+    {
+      putbuf(ub.kaddr, ub.size);
+      bytes += ub.size;
+    }
+
+    return bytes;
   }
 
-  lock_acquire(&filesys_lock);
- 
   struct file *f = get_file(fd);
 
   if(f == NULL)
-  {
-    lock_release(&filesys_lock);
-
     return -1;
-  }
 
-  int bytes = file_write(f, buffer, size);
+  /* Write straight from the user's frames, one pinned page at a
+     time. */
+  user_buffer_init(&ub, (void *)buffer, size, false);
+  while(user_buffer_next(&ub))
+  {
+    int n = file_write(f, ub.kaddr, ub.size);
 
-  lock_release(&filesys_lock);
+    bytes += n;
+    if((size_t)n < ub.size)
+      break;
+  }
+  user_buffer_finish(&ub);
 
   return bytes;
 }
 
 static void sys_seek(int fd, unsigned position)
 {
-  lock_acquire(&filesys_lock);
- 
   struct file *f = get_file(fd);
 
-  if(f == NULL)
-  {
-    lock_release(&filesys_lock);
-
-    return;
-  }
-
-  file_seek(f, position);
-
-  lock_release(&filesys_lock);
+  if(f != NULL)
+    file_seek(f, position);
 }
 
 static unsigned sys_tell(int fd)
 {
-  lock_acquire(&filesys_lock);
- 
   struct file *f = get_file(fd);
 
   if(f == NULL)
-  {
-    lock_release(&filesys_lock);
+    return -1;
+
+  return file_tell(f);
+}
+
+static void sys_close(int fd)
+{
+  remove_file(fd);
+}
+
+static int sys_getrusage(struct rusage *usage)
+{
+  struct thread *t = thread_current();
+
+  t->rusage.ticks = timer_elapsed(t->start_tick);
+  if(!copy_to_user(usage, &(t->rusage), sizeof *usage))
+    sys_exit(-1);
 
+  return 0;
+}
+
+
+
+/* Sets the resident set limit to PAGES, or makes it adaptive if
+   PAGES is 0.  Returns the previous fixed limit (0 if it was
+   adaptive), or -1 if PAGES is negative. */
+static int sys_rsslimit(int pages)
+{
+  int old = (int)thread_current()->rss_limit;
+
+  if(pages < 0)
     return -1;
-  }
 
-  off_t pos = file_tell(f);
+  page_set_rss_limit((size_t)pages);
+
+  return old;
+}
+
+/* Starts the asynchronous read or write described by REQUEST.
+   Returns its identifier, or -1 if it cannot be started. */
+static int sys_aio_submit(const struct aio_request *request)
+{
+  struct aio_request r;
+
+  if(!copy_from_user(&r, request, sizeof r))
+    sys_exit(-1);
 
-  lock_release(&filesys_lock);
+  /* Refuse an oversized request before probing its buffer. */
+  if(r.size > AIO_MAX_SIZE)
+    return -1;
+  check_user_buffer(r.buffer, r.size, !r.write);
 
-  return pos;
+  return aio_submit(&r);
 }
 
-static void sys_close(int fd)
+/* Stores a completed asynchronous request into COMPLETION, first
+   waiting for one if WAIT is true.  Returns false if there is
+   none to report. */
+static bool sys_aio_reap(struct aio_completion *completion, bool wait)
 {
-  lock_acquire(&filesys_lock);
+  struct aio_completion c;
 
-  remove_file(fd);
+  check_user_buffer(completion, sizeof *completion, true);
+  if(!aio_reap(&c, wait))
+    return false;
 
-  lock_release(&filesys_lock);
+  if(!copy_to_user(completion, &c, sizeof c))
+    sys_exit(-1);
+
+  return true;
 }
 
+/* Returns T's page faults per second over its lifetime. */
+static long long fault_rate(struct thread *t)
+{
+  int64_t ticks = timer_elapsed(t->start_tick);
+  long long faults = t->rusage.minor_faults + t->rusage.major_faults;
 
+  return ticks > 0 ? faults * TIMER_FREQ / ticks : faults * TIMER_FREQ;
+}
 
-static bool is_valid_ptr(const void *vaddr)
+/* Reads a byte at user virtual address UADDR.
+   Returns the byte value if successful, -1 if UADDR is not a
+   mapped user address.  A fault on UADDR makes page_fault() resume
+   at label 1 with -1 in eax. */
+static int get_user(const uint8_t *uaddr)
 {
-  return is_user_vaddr(vaddr) && vaddr >= (void *)0x08048000 && get_pte_by_vaddr ((void *)vaddr) != NULL;
+  int result;
+
+  if(!is_user_vaddr(uaddr))
+    return -1;
+
+  asm ("movl $1f, %0; movzbl %1, %0; 1:"
+       : "=&a" (result) : "m" (*uaddr));
+
+  return result;
 }
 
-static void check_usable_ptr(const void *vaddr)
+/* Writes BYTE to user address UDST.
+   Returns true if successful, false if UDST is not a writable
+   user address. */
+static bool put_user(uint8_t *udst, uint8_t byte)
 {
-  int i;
+  int error_code;
+
+  if(!is_user_vaddr(udst))
+    return false;
+
+  asm ("movl $1f, %0; movb %b2, %1; 1:"
+       : "=&a" (error_code), "=m" (*udst) : "q" (byte));
+
+  return error_code != -1;
+}
+
+/* Copies SIZE bytes from user address USRC to kernel buffer DST.
+   Returns false if any of the source bytes is not readable. */
+static bool copy_from_user(void *dst, const void *usrc, size_t size)
+{
+  uint8_t *d = dst;
+  const uint8_t *s = usrc;
 
-  for(i = 0;i < 4;i++) 
+  for(; size > 0; size--)
   {
-    if (!is_valid_ptr ((const void *)((int)vaddr + i)))
-      sys_exit (-1);
+    int byte = get_user(s++);
+
+    if(byte == -1)
+      return false;
+
+    *d++ = byte;
   }
+
+  return true;
 }
 
+/* Copies SIZE bytes from kernel buffer SRC to user address UDST.
+   Returns false if any of the destination bytes is not
+   writable. */
+static bool copy_to_user(void *udst, const void *src, size_t size)
+{
+  uint8_t *d = udst;
+  const uint8_t *s = src;
+
+  for(; size > 0; size--)
+    if(!put_user(d++, *s++))
+      return false;
 
+  return true;
+}
 
-void get_args(struct intr_frame *f, int *args, int num)
+/* Copies the null-terminated string at user address US into a
+   new kernel page, which the caller must free with
+   palloc_free_page().  Kills the process if the string is not
+   readable; a string that does not fit in a page is truncated. */
+static char *copy_in_string(const char *us)
 {
-  int i;
-  void *vaddr;
+  char *ks = palloc_get_page(0);
+  size_t i;
 
-  for(i = 0;i < num;i++)
+  if(ks == NULL)
+    sys_exit(-1);
+
+  for(i = 0; i < PGSIZE - 1; i++)
   {
-    vaddr = (f->esp + (sizeof(void *) * (i + 1)));
+    int byte = get_user((const uint8_t *)us + i);
+
+    if(byte == -1)
+    {
+      palloc_free_page(ks);
+      sys_exit(-1);
+    }
+
+    ks[i] = byte;
 
-    check_usable_ptr((const void *)vaddr);
-    
-    //printf("esp[%d] : %08x\n", i, (unsigned)(f->esp + (sizeof(void *) * (i + 1))));
-    args[i] = *(int *)(f->esp + (sizeof(void *) * (i + 1)));
-    // printf("args[%d] : %08x\n", i, args[i]);
+    if(byte == '\0')
+      return ks;
   }
+
+  ks[PGSIZE - 1] = '\0';
+
+  return ks;
 }
 
-static int user_to_kernel_address(const void *vaddr)
+/* Kills the process unless the SIZE bytes at user address UBUF
+   are accessible, and writable if WRITE is true.  One byte per
+   page is probed; the kernel may then access the buffer in place,
+   since page_fault() pages it back in if it is evicted. */
+static void check_user_buffer(const void *ubuf, unsigned size, bool write)
 {
-  check_usable_ptr(vaddr);
+  uint8_t *p = (uint8_t *)ubuf;
+  uint8_t *end = p + size;
 
-  //printf("vaddr : %08x\n", (unsigned)vaddr);
+  if(size == 0)
+    return;
 
-  void *ptr = pagedir_get_page(thread_current()->pagedir, vaddr);
+  if(end < p || !is_user_vaddr(end - 1))
+    sys_exit(-1);
 
-  //printf("ptr : %08x\n", (unsigned)ptr);
+  for(; p < end; p = (uint8_t *)pg_round_down(p) + PGSIZE)
+  {
+    int byte = get_user(p);
 
-  if(ptr == NULL)
-    sys_exit(-1);
+    if(byte == -1 || (write && !put_user(p, byte)))
+      sys_exit(-1);
+  }
+}
 
-  return (int)ptr;
+void get_args(struct intr_frame *f, int *args, int num)
+{
+  if(!copy_from_user(args, (uint8_t *)f->esp + sizeof(void *), num * sizeof *args))
+    sys_exit(-1);
 }
@@ -1,8 +1,13 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
+
 void syscall_init (void);
 
 void sys_exit(int status);
 
+/* -vmstat: print VM statistics when a process exits? */
+extern bool rusage_on_exit;
+
 #endif /* userprog/syscall.h */
@@ -0,0 +1,102 @@
+#include "vm/area.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+#include <debug.h>
+#include <string.h>
+
+/* Returns the index of the first area in MAP that ends above
+   VADDR, or MAP->cnt if there is none. */
+static size_t
+lower_bound (const struct vm_area_map *map, const void *vaddr)
+{
+  size_t lo = 0, hi = map->cnt;
+
+  while (lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+
+    if (map->areas[mid]->end <= vaddr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+void vm_area_map_init (struct vm_area_map *map)
+{
+  map->areas = NULL;
+  map->cnt = 0;
+  map->capacity = 0;
+}
+
+/* Frees MAP and every area in it. */
+void vm_area_map_destroy (struct vm_area_map *map)
+{
+  size_t i;
+
+  for (i = 0; i < map->cnt; i++)
+    free (map->areas[i]);
+
+  free (map->areas);
+  vm_area_map_init (map);
+}
+
+/* Adds VMA, which must be malloc()'d, to MAP, which takes
+   ownership of it.  Returns false if VMA overlaps an area already
+   in MAP or memory is exhausted. */
+bool vm_area_insert (struct vm_area_map *map, struct vm_area *vma)
+{
+  size_t i;
+
+  ASSERT (pg_ofs (vma->start) == 0);
+  ASSERT (pg_ofs (vma->end) == 0);
+  ASSERT (vma->start < vma->end);
+
+  i = lower_bound (map, vma->start);
+
+  if (i < map->cnt && map->areas[i]->start < vma->end)
+    return false;
+
+  if (map->cnt == map->capacity)
+  {
+    size_t capacity = map->capacity == 0 ? 4 : map->capacity * 2;
+    struct vm_area **areas = realloc (map->areas, capacity * sizeof *areas);
+
+    if (areas == NULL)
+      return false;
+
+    map->areas = areas;
+    map->capacity = capacity;
+  }
+
+  memmove (map->areas + i + 1, map->areas + i, (map->cnt - i) * sizeof *map->areas);
+  map->areas[i] = vma;
+  map->cnt++;
+
+  return true;
+}
+
+/* Returns the area of MAP containing VADDR, or NULL. */
+struct vm_area *vm_area_find (const struct vm_area_map *map, const void *vaddr)
+{
+  size_t i = lower_bound (map, vaddr);
+
+  if (i < map->cnt && map->areas[i]->start <= vaddr)
+    return map->areas[i];
+
+  return NULL;
+}
+
+/* Returns how many bytes of the page at UPAGE in VMA come from
+   its file; the rest of the page is zero. */
+uint32_t vm_area_read_bytes (const struct vm_area *vma, const void *upage)
+{
+  uint32_t offset = (uint8_t *) upage - (uint8_t *) vma->start;
+
+  if (offset >= vma->read_bytes)
+    return 0;
+
+  return vma->read_bytes - offset < PGSIZE ? vma->read_bytes - offset : PGSIZE;
+}
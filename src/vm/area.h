@@ -0,0 +1,37 @@
+#ifndef VM_AREA_H
+#define VM_AREA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A virtual memory area: the pages [START, END) of a process that
+   share one backing.  A VM_BIN area reads its first READ_BYTES
+   bytes from F starting at offset OFS and is zero past that; a
+   VM_ANON area is zero-filled. */
+struct vm_area
+{
+  int type;				/* VM_BIN or VM_ANON. */
+  void *start;				/* First page, page-aligned. */
+  void *end;				/* One past the last page. */
+  struct file *f;			/* Backing file, or NULL. */
+  int32_t ofs;				/* Offset in F of START. */
+  uint32_t read_bytes;			/* Bytes of F mapped at START. */
+  bool writable;
+};
+
+/* The areas of one process, sorted by address. */
+struct vm_area_map
+{
+  struct vm_area **areas;		/* Sorted array of areas. */
+  size_t cnt;				/* Number of areas. */
+  size_t capacity;			/* Allocated size of AREAS. */
+};
+
+void vm_area_map_init (struct vm_area_map *);
+void vm_area_map_destroy (struct vm_area_map *);
+bool vm_area_insert (struct vm_area_map *, struct vm_area *);
+struct vm_area *vm_area_find (const struct vm_area_map *, const void *);
+uint32_t vm_area_read_bytes (const struct vm_area *, const void *);
+
+#endif
@@ -1,14 +1,49 @@
 #include "vm/frame.h"
+#include "vm/swap.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/malloc.h"
+#include "userprog/pagedir.h"
 #include <debug.h>
+#include <stdio.h>
 
 struct lock frame_lock;
 struct list frame_table;
 struct list_elem *page_cursor;
 
+/* Free user frame watermarks.  The page-out daemon is woken when
+   free frames drop below PAGEOUT_LOW and reclaims until there are
+   PAGEOUT_HIGH.  Zero picks a default from the user pool size. */
+size_t pageout_low;
+size_t pageout_high;
+
+/* Frames are written to swap with frame_lock released, so that
+   faults elsewhere need not wait for the disk.  Meanwhile the
+   owner's pageout_cnt is nonzero, which keeps it from tearing
+   down its page table, and an evicted page's in_transit is set,
+   which keeps the owner from faulting it back in.  Signaled,
+   with frame_lock, when such a write finishes. */
+static struct condition pageout_done;
+
+static struct semaphore pageout_sema;	/* Upped to wake the daemon. */
+static bool pageout_started;		/* Daemon is running. */
+static bool pageout_pending;		/* Daemon has been woken. */
+
+/* Statistics. */
+static long long direct_cnt;		/* Frames reclaimed by faults. */
+static long long local_cnt;		/* Frames replaced within a process. */
+static long long background_cnt;	/* Frames reclaimed by daemon. */
+static long long preclean_cnt;		/* Dirty frames pre-cleaned. */
+
+static struct page* get_evict_page(bool, struct thread *);
+static void clean_page(struct page *);
+static bool reclaim_page(bool, struct thread *);
+static void pageout_daemon(void *);
+
 void frame_table_init(void)
 {
   lock_init(&frame_lock);
+  cond_init(&pageout_done);
   list_init(&frame_table);
   page_cursor = NULL;
 }
@@ -27,6 +62,10 @@ void add_page(struct page *p)
 void remove_page(struct page *p)
 {
   lock_acquire(&frame_lock);
+
+  if (page_cursor == &(p->elem))
+    page_cursor = list_next (page_cursor);
+
   list_remove(&(p->elem));
   lock_release(&frame_lock);
 }
@@ -47,22 +86,284 @@ struct page* get_page_by_kaddr(void *kaddr)
 
   return NULL;
 }
-/*
-struct page* get_evict_page(void)
+
+/* Picks a victim frame with the clock algorithm.  Frames that are
+   pinned or not yet installed are skipped, and recently accessed
+   frames get a second chance.  If BACKGROUND, dirty frames are
+   cleaned and passed over instead of chosen, so that they can be
+   dropped without I/O on a later sweep.  If OWNER is nonnull,
+   only its frames are considered.  Must be called with frame_lock
+   held.  Returns NULL if every candidate frame is pinned. */
+static struct page* get_evict_page(bool background, struct thread *owner)
+{
+  size_t n = list_size (&frame_table);
+  size_t i;
+
+  /* Two sweeps are enough to clear every accessed bit once. */
+  for (i = 0; i < 2 * n + 1; i++)
+  {
+    struct page *p;
+
+    if (page_cursor == NULL || page_cursor == list_end (&frame_table))
+      page_cursor = list_begin (&frame_table);
+
+    if (page_cursor == list_end (&frame_table))
+      return NULL;
+
+    p = list_entry (page_cursor, struct page, elem);
+    page_cursor = list_next (page_cursor);
+
+    if (p->pin_cnt > 0 || p->pte == NULL || p->thread->pagedir == NULL
+        || (owner != NULL && p->thread != owner))
+      continue;
+
+    if (pagedir_is_accessed (p->thread->pagedir, p->pte->vaddr))
+    {
+      pagedir_set_accessed (p->thread->pagedir, p->pte->vaddr, false);
+      continue;
+    }
+
+    if (background && pagedir_is_dirty (p->thread->pagedir, p->pte->vaddr))
+    {
+      clean_page (p);
+      continue;
+    }
+
+    return p;
+  }
+
+  return NULL;
+}
+
+/* Writes FRAME's page to swap with frame_lock, which must be held,
+   released for the duration, and returns the swap slot.  T owns
+   the page. */
+static size_t write_out(struct thread *t, void *frame)
+{
+  size_t slot;
+
+  t->pageout_cnt++;
+  lock_release (&frame_lock);
+  slot = swap_out (frame);
+  lock_acquire (&frame_lock);
+  t->pageout_cnt--;
+  cond_broadcast (&pageout_done, &frame_lock);
+
+  return slot;
+}
+
+/* Waits for a write to swap in progress to finish.  Must be
+   called with frame_lock held, which is released while
+   waiting. */
+void frame_wait_pageout(void)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  cond_wait (&pageout_done, &frame_lock);
+}
+
+/* Writes dirty frame P to swap but leaves it mapped, so that the
+   page can later be evicted without waiting for the write.  P is
+   pinned during the write, so that it is not chosen meanwhile.
+   Must be called with frame_lock held. */
+static void clean_page(struct page *p)
+{
+  struct page_table_entry *pte = p->pte;
+  size_t slot;
+
+  /* Clear the dirty bit before copying: a store that races with the
+     copy sets it again, and the stale copy is then never used. */
+  pagedir_set_dirty (p->thread->pagedir, pte->vaddr, false);
+
+  p->pin_cnt++;
+  slot = write_out (p->thread, p->kaddr);
+  p->pin_cnt--;
+
+  if (pte->swap_slot != SWAP_NONE)
+    swap_free (pte->swap_slot);
+  pte->swap_slot = slot;
+  pte->anon = true;
+
+  p->thread->rusage.swap_outs++;
+  preclean_cnt++;
+}
+
+/* Evicts one user frame and returns it to the user pool.  A page
+   with a clean copy in swap, or whose contents still match its
+   area, is simply dropped, the latter along with its page table
+   entry; any other page is written to swap first.  If OWNER is
+   nonnull, the frame is one of OWNER's.  Returns false if no frame
+   could be evicted. */
+static bool reclaim_page(bool background, struct thread *owner)
 {
   struct page *p;
+  struct page_table_entry *pte;
+  struct thread *t;
+  uint32_t *pd;
+  bool dirty;
 
+  lock_acquire(&frame_lock);
 
-  if (page_cursor == NULL || page_cursor == list_end (&frame_table))
-    page_cursor = list_begin (&frame_table);
-  else
+  p = get_evict_page (background, owner);
+
+  if (p == NULL)
   {
+    lock_release(&frame_lock);
+    return false;
+  }
+
+  if (page_cursor == &(p->elem))
     page_cursor = list_next (page_cursor);
+  list_remove (&(p->elem));
 
-    if (page_cursor == list_end (&frame_table))
-      page_cursor = list_next (page_cursor);
+  pte = p->pte;
+  t = p->thread;
+  pd = t->pagedir;
+
+  /* Unmap first so that the owner faults (and waits on
+     frame_lock) instead of touching the frame while it is being
+     written out. */
+  dirty = pagedir_is_dirty (pd, pte->vaddr);
+  pagedir_clear_page (pd, pte->vaddr);
+
+  t->rusage.evictions++;
+  page_account_rss (t, -1);
+
+  if (dirty || (pte->anon && pte->swap_slot == SWAP_NONE))
+  {
+    size_t slot;
+
+    pte->in_transit = true;
+    slot = write_out (t, p->kaddr);
+    pte->in_transit = false;
+
+    if (pte->swap_slot != SWAP_NONE)
+      swap_free (pte->swap_slot);
+    pte->swap_slot = slot;
+    pte->anon = true;
+    t->rusage.swap_outs++;
+  }
+
+  if (pte->swap_slot != SWAP_NONE)
+    pte->frame = NULL;
+  else
+  {
+    lock_acquire (&t->page_table_lock);
+    pte_delete (&t->page_table, pte);
+    lock_release (&t->page_table_lock);
+    free (pte);
+  }
+
+  palloc_free_page (p->kaddr);
+  free (p);
+
+  if (background)
+    background_cnt++;
+  else if (owner != NULL)
+    local_cnt++;
+  else
+    direct_cnt++;
+
+  lock_release(&frame_lock);
+
+  return true;
+}
+
+/* Evicts one user frame on behalf of a thread that found the user
+   pool empty.  Returns false if no frame could be evicted. */
+bool evict_page(void)
+{
+  pageout_check ();
+
+  return reclaim_page (false, NULL);
+}
+
+/* Evicts one of T's frames, so that T can stay within its
+   resident set limit.  Returns false if T has no evictable frame. */
+bool evict_own_page(struct thread *t)
+{
+  return reclaim_page (false, t);
+}
+
+/* Starts the page-out daemon, which needs swap to be set up. */
+void pageout_init(void)
+{
+  size_t user_pages = palloc_page_cnt (PAL_USER);
+
+  if (pageout_low == 0)
+    pageout_low = user_pages / 32 > 4 ? user_pages / 32 : 4;
+  if (pageout_high <= pageout_low)
+    pageout_high = 2 * pageout_low;
+
+  sema_init (&pageout_sema, 0);
+  pageout_started = thread_create ("pageout", PRI_MIN, pageout_daemon, NULL) != TID_ERROR;
+}
+
+/* Wakes the page-out daemon if free user frames have dropped
+   below the low watermark. */
+void pageout_check(void)
+{
+  if (pageout_started && !pageout_pending
+      && palloc_free_cnt (PAL_USER) < pageout_low)
+  {
+    pageout_pending = true;
+    sema_up (&pageout_sema);
+  }
+}
+
+/* Page-out daemon.  Runs at the lowest priority, so it reclaims
+   while user processes wait on I/O, ahead of their next faults. */
+static void pageout_daemon(void *aux UNUSED)
+{
+  for (;;)
+  {
+    sema_down (&pageout_sema);
+
+    while (palloc_free_cnt (PAL_USER) < pageout_high
+           && reclaim_page (true, NULL))
+      continue;
+
+    pageout_pending = false;
+  }
+}
+
+/* Prints page-out statistics. */
+void frame_print_stats(void)
+{
+  printf ("Page-out: %lld frames reclaimed directly, %lld locally, "
+          "%lld by daemon, %lld pre-cleaned\n",
+          direct_cnt, local_cnt, background_cnt, preclean_cnt);
+}
+
+/* Releases whatever backs PTE: its frame if it is resident and its
+   swap slot if it has one.  The unmapping is added to TLB,
+   whose page directory must be the one PTE belongs to, and the
+   frame is freed only once TLB is finished.  Must be called with
+   frame_lock held. */
+void free_pte_frame(struct page_table_entry *pte, struct tlb_gather *tlb)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  if (pte->swap_slot != SWAP_NONE)
+  {
+    swap_free (pte->swap_slot);
+    pte->swap_slot = SWAP_NONE;
   }
 
-  p = list_entry (page_cursor, struct page, elem);
+  if (pte->frame != NULL)
+  {
+    struct page *p = pte->frame;
+
+    pagedir_clear_page_batched (tlb, pte->vaddr);
+
+    if (page_cursor == &(p->elem))
+      page_cursor = list_next (page_cursor);
+    list_remove (&(p->elem));
+    tlb_gather_free_page (tlb, p->kaddr);
+    free (p);
+
+    page_account_rss (thread_current (), -1);
+
+    pte->frame = NULL;
+  }
 }
-*/
@@ -2,11 +2,22 @@
 #define VM_FRAME_H
 
 #include "vm/page.h"
+#include "userprog/pagedir.h"
 
 void frame_table_init(void);
 void add_page(struct page *);
 void remove_page(struct page *);
 struct page* get_page_by_kaddr(void *);
-//struct page* get_evict_page(void);
+bool evict_page(void);
+bool evict_own_page(struct thread *);
+void free_pte_frame(struct page_table_entry *, struct tlb_gather *);
+void frame_wait_pageout(void);
+
+extern size_t pageout_low;
+extern size_t pageout_high;
+
+void pageout_init(void);
+void pageout_check(void);
+void frame_print_stats(void);
 
 #endif
@@ -1,8 +1,13 @@
 #include "page.h"
+#include "vm/frame.h"
 #include "threads/thread.h"
 #include "threads/malloc.h"
 #include "threads/vaddr.h"
+#include "threads/synch.h"
 #include "filesys/file.h"
+#include "userprog/pagedir.h"
+#include "vm/swap.h"
+#include "devices/timer.h"
 #include <string.h>
 #include <debug.h>
 #include <stdio.h>
@@ -12,6 +17,8 @@ static unsigned pt_hash_func(const struct hash_elem *, void *);
 static bool pt_less_func(const struct hash_elem *, const struct hash_elem *, void *);
 static void pt_destroy_func(struct hash_elem *, void *);
 
+/* lock for frame table(from frame.c) */
+extern struct lock frame_lock;
 
 void page_table_init(struct hash *page_table)
 {
@@ -21,8 +28,25 @@ void page_table_init(struct hash *page_table)
 
 void page_table_destroy(struct hash *page_table)
 {
+  struct thread *t = thread_current ();
+  struct tlb_gather tlb;
+
   ASSERT (page_table != NULL);
+
+  /* Unmap every page with at most one TLB flush at the end.  The
+     gather reaches pt_destroy_func() as the hash's aux. */
+  tlb_gather_init (&tlb, t->pagedir);
+  lock_acquire (&frame_lock);
+  while (t->pageout_cnt > 0)
+    frame_wait_pageout ();
+  lock_acquire (&t->page_table_lock);
+  page_table->aux = &tlb;
   hash_destroy(page_table, pt_destroy_func);
+  lock_release (&t->page_table_lock);
+  lock_release (&frame_lock);
+  tlb_gather_finish (&tlb);
+
+  vm_area_map_destroy (&t->vm_areas);
 }
 
 static unsigned pt_hash_func(const struct hash_elem *e, void *aux UNUSED)
@@ -39,14 +63,18 @@ static bool pt_less_func(const struct hash_elem *a, const struct hash_elem *b, v
   return hash_entry(a, struct page_table_entry, elem)->vaddr < hash_entry(b, struct page_table_entry, elem)->vaddr;
 }
 
-static void pt_destroy_func(struct hash_elem *e, void *aux UNUSED)
+static void pt_destroy_func(struct hash_elem *e, void *aux)
 {
   ASSERT(e != NULL);
 
   struct page_table_entry *pte = hash_entry(e, struct page_table_entry, elem);
+
+  free_pte_frame(pte, aux);
   free(pte);
 }
 
+/* Returns the current thread's entry for the page containing
+   VADDR, or NULL.  The caller must hold page_table_lock. */
 struct page_table_entry* get_pte_by_vaddr(void *vaddr)
 {
   struct hash *page_table;
@@ -73,6 +101,7 @@ void pte_insert (struct hash *page_table, struct page_table_entry *pte)
   ASSERT (pte != NULL);
   ASSERT (pg_ofs (pte->vaddr) == 0);
 
+  pte->swap_slot = SWAP_NONE;
   hash_insert (page_table, &(pte->elem));
 }
 
@@ -83,7 +112,10 @@ void pte_delete (struct hash *page_table, struct page_table_entry *pte)
 
   hash_delete (page_table, &(pte->elem));
 }
-/*
+/* Allocates a user frame for the current thread, evicting another
+   frame if the user pool is exhausted.  The frame is returned
+   pinned; the caller unpins it once its PTE is installed.
+   Returns a null pointer if no frame can be found. */
 struct page* page_alloc(enum palloc_flags flags)
 {
   struct page *p;
@@ -95,20 +127,349 @@ struct page* page_alloc(enum palloc_flags flags)
   memset(p, 0, sizeof(struct page));
 
   p->thread = thread_current();
-  p->kaddr = palloc_get_page(flags);
+  p->pin_cnt = 1;
+
+  while ((p->kaddr = palloc_get_page(flags | PAL_USER)) == NULL)
+    if (!evict_page ())
+    {
+      free (p);
+      return NULL;
+    }
+
+  add_page (p);
+  pageout_check ();
 
   return p;
 }
-*/
+
+/* Frees the frame at KADDR and drops it from the frame table. */
+void page_free(void *kaddr)
+{
+  struct page *p;
+
+  lock_acquire (&frame_lock);
+  p = get_page_by_kaddr (kaddr);
+  lock_release (&frame_lock);
+
+  if (p != NULL)
+  {
+    remove_page (p);
+    free (p);
+  }
+
+  palloc_free_page (kaddr);
+}
+
 bool load_page (struct page_table_entry *pte, void *kaddr)
 {
   ASSERT (pte != NULL);
   ASSERT (kaddr != NULL);
 
-  if ((uint32_t)file_read_at (pte->f, kaddr, pte->read_bytes, pte->ofs) != pte->read_bytes)
+  struct vm_area *vma = pte->vma;
+  uint32_t read_bytes = vm_area_read_bytes (vma, pte->vaddr);
+  int32_t ofs = vma->ofs + ((uint8_t *) pte->vaddr - (uint8_t *) vma->start);
+  bool success = true;
+
+  if (read_bytes > 0)
+    success = (uint32_t)file_read_at (vma->f, kaddr, read_bytes, ofs) == read_bytes;
+
+  if (!success)
     return false;
 
-  memset (kaddr + pte->read_bytes, 0, pte->zero_bytes);
+  thread_current ()->rusage.load_bytes += read_bytes;
+
+  memset (kaddr + read_bytes, 0, PGSIZE - read_bytes);
 
   return true;
 }
+
+/* Returns the entry for UPAGE in the current thread's page table,
+   creating it from the area holding UPAGE if there is none.
+   Returns NULL if UPAGE is in no area or memory is exhausted. */
+static struct page_table_entry *pte_get_or_create (void *upage)
+{
+  struct thread *t = thread_current ();
+  struct vm_area *vma;
+  struct page_table_entry *pte;
+
+  pte = get_pte_by_vaddr (upage);
+  if (pte != NULL)
+    return pte;
+
+  vma = vm_area_find (&t->vm_areas, upage);
+  if (vma == NULL)
+    return NULL;
+
+  pte = (struct page_table_entry *)malloc (sizeof (struct page_table_entry));
+  if (pte == NULL)
+    return NULL;
+
+  pte->vaddr = upage;
+  pte->vma = vma;
+  pte->frame = NULL;
+  pte->anon = false;
+  pte->in_transit = false;
+  pte_insert (&(t->page_table), pte);
+
+  return pte;
+}
+
+/* Keeps T within its resident set limit before it takes another
+   frame.  At the limit, an adaptive limit grows if T is faulting
+   often and shrinks by a page if not; T then replaces its own
+   frames to stay within it. */
+static void rss_enforce (struct thread *t)
+{
+  struct rusage *ru = &t->rusage;
+  int64_t now = timer_ticks ();
+  bool frequent = now - t->fault_tick < RSS_PFF_TICKS;
+
+  t->fault_tick = now;
+
+  if (ru->rss < ru->rss_limit)
+    return;
+
+  if (t->rss_limit == 0)
+  {
+    if (frequent && ru->rss_limit < palloc_page_cnt (PAL_USER) / 4 * 3)
+    {
+      ru->rss_limit++;
+      return;
+    }
+    if (!frequent && ru->rss_limit > RSS_MIN_PAGES)
+      ru->rss_limit--;
+  }
+
+  while (ru->rss >= ru->rss_limit && evict_own_page (t))
+    ru->local_evictions++;
+}
+
+/* Sets the current thread's resident set limit to PAGES, or makes
+   it adaptive if PAGES is 0.  Frames over a lowered limit are
+   given up at the following faults. */
+void page_set_rss_limit (size_t pages)
+{
+  struct thread *t = thread_current ();
+
+  t->rss_limit = pages;
+
+  if (pages != 0)
+    t->rusage.rss_limit = pages;
+  else if (t->rusage.rss_limit < RSS_MIN_PAGES)
+    t->rusage.rss_limit = RSS_MIN_PAGES;
+}
+
+/* Brings the user page containing VADDR into a fresh frame, from
+   swap, from the executable, or as a zeroed page, and maps it.
+   Returns true if the page is resident afterward, false if VADDR
+   is not part of the address space or loading failed. */
+bool page_load (void *vaddr)
+{
+  struct thread *t = thread_current ();
+  struct rusage *ru = &t->rusage;
+  void *upage = pg_round_down (vaddr);
+  struct page_table_entry *pte;
+  struct page *p;
+  bool success = true;
+  bool major = false;
+
+  if (vm_area_find (&t->vm_areas, upage) == NULL)
+    return false;
+
+  rss_enforce (t);
+
+  p = page_alloc (PAL_USER);
+
+  if (p == NULL)
+    return false;
+
+  /* Look the entry up under frame_lock, waiting out any eviction of
+     this very page that is writing it to swap.  Any other eviction
+     is over (and the entry gone, if the page was dropped) once the
+     lock is ours. */
+  lock_acquire (&frame_lock);
+  lock_acquire (&t->page_table_lock);
+  pte = pte_get_or_create (upage);
+  while (pte != NULL && pte->in_transit)
+  {
+    lock_release (&t->page_table_lock);
+    frame_wait_pageout ();
+    lock_acquire (&t->page_table_lock);
+    pte = pte_get_or_create (upage);
+  }
+  lock_release (&t->page_table_lock);
+  lock_release (&frame_lock);
+
+  if (pte == NULL || pte->frame != NULL)
+  {
+    page_free (p->kaddr);
+    return pte != NULL;
+  }
+
+  p->pte = pte;
+
+  if (pte->swap_slot != SWAP_NONE)
+  {
+    major = swap_in (pte->swap_slot, p->kaddr);
+    pte->swap_slot = SWAP_NONE;
+    ru->swap_ins++;
+  }
+  else if (pte->vma->type == VM_BIN)
+  {
+    success = load_page (pte, p->kaddr);
+    major = vm_area_read_bytes (pte->vma, upage) > 0;
+  }
+  else
+    memset (p->kaddr, 0, PGSIZE);
+
+  if (!success || !pagedir_set_page (t->pagedir, upage, p->kaddr, pte->vma->writable))
+  {
+    page_free (p->kaddr);
+
+    return false;
+  }
+
+  pte->frame = p;
+  p->pin_cnt--;
+
+  if (major)
+    ru->major_faults++;
+  else
+    ru->minor_faults++;
+  page_account_rss (t, 1);
+
+  return true;
+}
+
+/* Pins the user page containing VADDR in its frame, faulting it
+   in first if necessary, and returns the kernel address that
+   corresponds to VADDR.  Returns a null pointer if VADDR is not
+   part of the address space, or if WRITE is true and the page is
+   read-only. */
+void *page_pin (const void *vaddr, bool write)
+{
+  struct thread *t = thread_current ();
+  void *upage = pg_round_down (vaddr);
+
+  for (;;)
+  {
+    struct page_table_entry *pte;
+    void *kaddr = NULL;
+    bool writable = true;
+
+    lock_acquire (&frame_lock);
+    lock_acquire (&t->page_table_lock);
+    pte = get_pte_by_vaddr (upage);
+    if (pte != NULL && pte->in_transit)
+    {
+      /* Its frame is being written out and will not stay. */
+      lock_release (&t->page_table_lock);
+      frame_wait_pageout ();
+      lock_release (&frame_lock);
+      continue;
+    }
+    if (pte != NULL && pte->frame != NULL)
+    {
+      writable = pte->vma->writable;
+      if (writable || !write)
+      {
+        pte->frame->pin_cnt++;
+        kaddr = pte->frame->kaddr;
+      }
+    }
+    lock_release (&t->page_table_lock);
+    lock_release (&frame_lock);
+
+    if (!writable && write)
+      return NULL;
+    if (kaddr != NULL)
+      return (uint8_t *) kaddr + pg_ofs (vaddr);
+
+    /* Not resident: bring it in and look again, since it may be
+       evicted before we get frame_lock back. */
+    if (!page_load (upage))
+      return NULL;
+  }
+}
+
+/* Unpins the user page containing VADDR, pinned by page_pin().
+   DIRTY says whether the kernel wrote the page through its kernel
+   address, which the user mapping's dirty bit does not see. */
+void page_unpin (const void *vaddr, bool dirty)
+{
+  struct thread *t = thread_current ();
+  void *upage = pg_round_down (vaddr);
+  struct page_table_entry *pte;
+
+  lock_acquire (&frame_lock);
+  lock_acquire (&t->page_table_lock);
+  pte = get_pte_by_vaddr (upage);
+  ASSERT (pte != NULL && pte->frame != NULL && pte->frame->pin_cnt > 0);
+  pte->frame->pin_cnt--;
+  if (dirty)
+    pagedir_set_dirty (t->pagedir, upage, true);
+  lock_release (&t->page_table_lock);
+  lock_release (&frame_lock);
+}
+
+/* Initializes UB to iterate over the SIZE bytes at user address
+   UADDR, which the kernel will write if WRITE is true. */
+void user_buffer_init (struct user_buffer *ub, void *uaddr, size_t size,
+                       bool write)
+{
+  ub->uaddr = uaddr;
+  ub->left = size;
+  ub->write = write;
+  ub->cur = NULL;
+  ub->kaddr = NULL;
+  ub->size = 0;
+}
+
+/* Unpins the current chunk of UB and pins the next one, which
+   extends at most to the end of its page.  Returns false when the
+   buffer is exhausted or the next page cannot be pinned. */
+bool user_buffer_next (struct user_buffer *ub)
+{
+  user_buffer_finish (ub);
+
+  if (ub->left == 0)
+    return false;
+
+  ub->kaddr = page_pin (ub->uaddr, ub->write);
+  if (ub->kaddr == NULL)
+    return false;
+
+  ub->cur = ub->uaddr;
+  ub->size = PGSIZE - pg_ofs (ub->uaddr);
+  if (ub->size > ub->left)
+    ub->size = ub->left;
+
+  ub->uaddr += ub->size;
+  ub->left -= ub->size;
+
+  return true;
+}
+
+/* Unpins the current chunk of UB, if any.  Must be called if the
+   iteration is abandoned before user_buffer_next() returns
+   false. */
+void user_buffer_finish (struct user_buffer *ub)
+{
+  if (ub->kaddr != NULL)
+  {
+    page_unpin (ub->cur, ub->write);
+    ub->kaddr = NULL;
+  }
+}
+
+/* Accounts for one page of T entering (DELTA = 1) or leaving
+   (DELTA = -1) memory. */
+void page_account_rss (struct thread *t, int delta)
+{
+  struct rusage *ru = &t->rusage;
+
+  ru->rss += delta;
+
+  if (ru->rss > ru->max_rss)
+    ru->max_rss = ru->rss;
+}
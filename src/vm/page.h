@@ -2,40 +2,80 @@
 #define VM_PAGE_H
 
 #include "threads/palloc.h"
+#include "vm/area.h"
 #include <hash.h>
+#include <list.h>
+
+struct thread;
 
 enum page_table_type
 {
   VM_ANON, VM_FILE, VM_BIN
 };
-/*
+
+/* A user frame in the frame table. */
 struct page
 {
-  void *kaddr;
-  struct page_table_entry *pte;
-  struct thread *thread;
-  struct list_elem elem;
+  void *kaddr;				/* Kernel address of the frame. */
+  struct page_table_entry *pte;		/* Virtual page held in the frame. */
+  struct thread *thread;		/* Owner of PTE. */
+  int pin_cnt;				/* Must not be evicted if nonzero. */
+  struct list_elem elem;		/* Element in frame_table. */
 };
-*/
+
+/* Resident set limits.  A process without a fixed limit starts at
+   RSS_MIN_PAGES and grows by a page for each fault that comes less
+   than RSS_PFF_TICKS after the previous one (page-fault frequency),
+   up to 3/4 of the user pool. */
+#define RSS_MIN_PAGES 16
+#define RSS_PFF_TICKS 4
+
+/* Swap slot of a page that is not in swap. */
+#define SWAP_NONE ((size_t) -1)
+
+/* Per-page state.  An entry exists only while its page is
+   resident or in swap; anything else about the page is described
+   by its vm_area.  The owner's page_table_lock guards the table. */
 struct page_table_entry
 {
-  int type;
-  struct file *f;
   void *vaddr;
-  int32_t ofs;
-  uint32_t read_bytes;
-  uint32_t zero_bytes;
-  bool writable;
-  bool loaded;
+  struct vm_area *vma;			/* Area containing VADDR. */
+  struct page *frame;			/* Frame holding the page, or NULL. */
+  bool anon;				/* Contents no longer match VMA. */
+  size_t swap_slot;			/* Swap slot, or SWAP_NONE. */
+  bool in_transit;			/* Being evicted to swap. */
   struct hash_elem elem;
 };
 
+/* Iterator over the pages of a user buffer.  Each page is faulted
+   in and pinned in its frame while it is the current chunk, so
+   the kernel can transfer directly to or from the frame. */
+struct user_buffer
+{
+  uint8_t *uaddr;			/* User address of the next chunk. */
+  size_t left;				/* Bytes after the current chunk. */
+  bool write;				/* Does the kernel write the buffer? */
+  uint8_t *cur;				/* User address of current chunk. */
+  void *kaddr;				/* Kernel address of current chunk. */
+  size_t size;				/* Size of current chunk. */
+};
+
 void page_table_init(struct hash *);
 void page_table_destroy(struct hash *);
+bool page_load (void *);
+void *page_pin (const void *, bool);
+void page_unpin (const void *, bool);
+
+void user_buffer_init (struct user_buffer *, void *, size_t, bool);
+bool user_buffer_next (struct user_buffer *);
+void user_buffer_finish (struct user_buffer *);
 struct page_table_entry* get_pte_by_vaddr(void *);
 void pte_insert (struct hash *, struct page_table_entry *);
 void pte_delete (struct hash *, struct page_table_entry *);
 
-//struct page* page_alloc(enum palloc_flags);
+struct page* page_alloc(enum palloc_flags);
+void page_free(void *);
 bool load_page (struct page_table_entry *, void *);
+void page_account_rss (struct thread *, int);
+void page_set_rss_limit (size_t);
 #endif
@@ -0,0 +1,93 @@
+#include "vm/swap.h"
+#include "vm/zswap.h"
+#include "devices/disk.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include <bitmap.h>
+#include <debug.h>
+
+/* Number of sectors in one swap slot. */
+#define SECTORS_PER_PAGE (PGSIZE / DISK_SECTOR_SIZE)
+
+static struct disk *swap_disk;		/* hd1:1 */
+static struct bitmap *swap_map;		/* One bit per swap slot. */
+static struct lock swap_lock;		/* Protects swap_map. */
+
+void swap_init(void)
+{
+  lock_init (&swap_lock);
+
+  swap_disk = disk_get (1, 1);
+  if (swap_disk == NULL)
+    return;
+
+  swap_map = bitmap_create (disk_size (swap_disk) / SECTORS_PER_PAGE);
+  if (swap_map == NULL)
+    PANIC ("swap bitmap creation failed");
+}
+
+/* Writes the page at KADDR to a free swap slot and returns the
+   slot.  The page goes to the compressed swap cache if it will
+   take it, otherwise straight to the swap disk. */
+size_t swap_out(void *kaddr)
+{
+  size_t slot;
+
+  if (swap_map == NULL)
+    PANIC ("no swap disk");
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (swap_map, 0, 1, false);
+  lock_release (&swap_lock);
+
+  if (slot == BITMAP_ERROR)
+    PANIC ("out of swap slots");
+
+  if (!zswap_store (slot, kaddr))
+    swap_write_slot (slot, kaddr);
+
+  return slot;
+}
+
+/* Reads swap SLOT into the page at KADDR and frees the slot.
+   Returns true if the swap disk had to be read, false if the
+   page came from the swap cache. */
+bool swap_in(size_t slot, void *kaddr)
+{
+  bool from_disk;
+
+  ASSERT (swap_map != NULL);
+  ASSERT (bitmap_test (swap_map, slot));
+
+  from_disk = !zswap_load (slot, kaddr);
+  if (from_disk)
+    swap_read_slot (slot, kaddr);
+
+  swap_free (slot);
+
+  return from_disk;
+}
+
+/* Discards the contents of swap SLOT. */
+void swap_free(size_t slot)
+{
+  zswap_invalidate (slot);
+
+  lock_acquire (&swap_lock);
+  bitmap_reset (swap_map, slot);
+  lock_release (&swap_lock);
+}
+
+/* Reads swap SLOT from the swap disk into the page at KADDR. */
+void swap_read_slot(size_t slot, void *kaddr)
+{
+  disk_read_multiple (swap_disk, slot * SECTORS_PER_PAGE, SECTORS_PER_PAGE,
+                      kaddr);
+}
+
+/* Writes the page at KADDR to swap SLOT on the swap disk. */
+void swap_write_slot(size_t slot, const void *kaddr)
+{
+  disk_write_multiple (swap_disk, slot * SECTORS_PER_PAGE, SECTORS_PER_PAGE,
+                       kaddr);
+}
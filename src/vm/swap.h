@@ -0,0 +1,15 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+void swap_init(void);
+size_t swap_out(void *);
+bool swap_in(size_t, void *);
+void swap_free(size_t);
+
+void swap_read_slot(size_t, void *);
+void swap_write_slot(size_t, const void *);
+
+#endif
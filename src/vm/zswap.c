@@ -0,0 +1,224 @@
+#include "vm/zswap.h"
+#include "vm/swap.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include <hash.h>
+#include <list.h>
+#include <lz.h>
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Compressed swap cache.
+
+   Pages on their way to the swap disk are compressed and kept
+   in kernel memory, keyed by the swap slot that was reserved for
+   them.  A later swap_in() of the slot is then served by
+   decompressing instead of 8 synchronous sector reads.  When the
+   cache exceeds zswap_page_limit pages, the least recently stored
+   entries are written back to their slots on the swap disk. */
+
+/* Pages that do not compress to half a page or less are not
+   worth caching and go straight to disk. */
+#define ZSWAP_MAX_SIZE (PGSIZE / 2)
+
+/* A compressed page. */
+struct zswap_entry
+{
+  size_t slot;				/* Swap slot it belongs to. */
+  size_t size;				/* Compressed size in bytes. */
+  uint8_t *data;			/* Compressed contents. */
+  struct hash_elem helem;		/* Element in zswap_map. */
+  struct list_elem lru_elem;		/* Element in zswap_lru. */
+};
+
+size_t zswap_page_limit = 0;
+
+static struct lock zswap_lock;		/* Protects everything below. */
+static struct hash zswap_map;		/* Entries by slot. */
+static struct list zswap_lru;		/* Oldest entry at the front. */
+static size_t zswap_bytes;		/* Compressed bytes held. */
+
+/* Scratch space, only used with zswap_lock held. */
+static uint8_t zswap_buf[PGSIZE];
+static uint16_t zswap_table[LZ_TABLE_SIZE];
+
+/* Statistics. */
+static long long store_cnt;		/* Pages accepted. */
+static long long reject_cnt;		/* Pages that did not compress. */
+static long long stored_bytes;		/* Compressed bytes accepted. */
+static long long load_cnt;		/* Swap-ins looked up. */
+static long long hit_cnt;		/* Swap-ins served from the cache. */
+static long long writeback_cnt;		/* Entries written to disk. */
+
+static unsigned zswap_hash_func(const struct hash_elem *, void *);
+static bool zswap_less_func(const struct hash_elem *, const struct hash_elem *, void *);
+static struct zswap_entry* zswap_find(size_t);
+static void zswap_remove(struct zswap_entry *);
+static void zswap_writeback(void);
+
+void zswap_init(void)
+{
+  lock_init (&zswap_lock);
+  hash_init (&zswap_map, zswap_hash_func, zswap_less_func, NULL);
+  list_init (&zswap_lru);
+  zswap_bytes = 0;
+}
+
+static unsigned zswap_hash_func(const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int ((int) hash_entry (e, struct zswap_entry, helem)->slot);
+}
+
+static bool zswap_less_func(const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED)
+{
+  return hash_entry (a, struct zswap_entry, helem)->slot
+         < hash_entry (b, struct zswap_entry, helem)->slot;
+}
+
+/* Returns the entry for SLOT, or NULL.  zswap_lock must be held. */
+static struct zswap_entry* zswap_find(size_t slot)
+{
+  struct zswap_entry key;
+  struct hash_elem *e;
+
+  key.slot = slot;
+  e = hash_find (&zswap_map, &key.helem);
+
+  return e != NULL ? hash_entry (e, struct zswap_entry, helem) : NULL;
+}
+
+/* Drops entry E.  zswap_lock must be held. */
+static void zswap_remove(struct zswap_entry *e)
+{
+  hash_delete (&zswap_map, &e->helem);
+  list_remove (&e->lru_elem);
+  zswap_bytes -= e->size;
+  free (e->data);
+  free (e);
+}
+
+/* Writes the least recently stored entry back to its swap slot
+   and drops it.  zswap_lock must be held. */
+static void zswap_writeback(void)
+{
+  struct zswap_entry *e;
+
+  ASSERT (!list_empty (&zswap_lru));
+
+  e = list_entry (list_front (&zswap_lru), struct zswap_entry, lru_elem);
+  if (lz_decompress (e->data, e->size, zswap_buf, PGSIZE) != PGSIZE)
+    PANIC ("swap cache: corrupt entry for slot %zu", e->slot);
+  swap_write_slot (e->slot, zswap_buf);
+  zswap_remove (e);
+  writeback_cnt++;
+}
+
+/* Tries to keep the page at KADDR, destined for swap SLOT, in the
+   cache.  Returns true if it was stored, false if the caller must
+   write it to disk itself. */
+bool zswap_store(size_t slot, const void *kaddr)
+{
+  struct zswap_entry *e;
+  size_t size;
+
+  if (zswap_page_limit == 0)
+    return false;
+
+  lock_acquire (&zswap_lock);
+
+  size = lz_compress (kaddr, PGSIZE, zswap_buf, ZSWAP_MAX_SIZE, zswap_table);
+  if (size == 0)
+    goto reject;
+
+  e = malloc (sizeof *e);
+  if (e == NULL)
+    goto reject;
+  e->data = malloc (size);
+  if (e->data == NULL)
+  {
+    free (e);
+    goto reject;
+  }
+
+  memcpy (e->data, zswap_buf, size);
+  e->slot = slot;
+  e->size = size;
+
+  /* Make room.  The write-backs reuse zswap_buf, which is why the
+     compressed data was copied out first. */
+  while (zswap_bytes + size > zswap_page_limit * PGSIZE
+         && !list_empty (&zswap_lru))
+    zswap_writeback ();
+
+  hash_insert (&zswap_map, &e->helem);
+  list_push_back (&zswap_lru, &e->lru_elem);
+  zswap_bytes += size;
+
+  store_cnt++;
+  stored_bytes += size;
+
+  lock_release (&zswap_lock);
+  return true;
+
+ reject:
+  reject_cnt++;
+  lock_release (&zswap_lock);
+  return false;
+}
+
+/* Decompresses swap SLOT into the page at KADDR if it is cached,
+   dropping the entry.  Returns true on a hit, false if the caller
+   must read the slot from disk. */
+bool zswap_load(size_t slot, void *kaddr)
+{
+  struct zswap_entry *e;
+
+  if (zswap_page_limit == 0)
+    return false;
+
+  lock_acquire (&zswap_lock);
+
+  load_cnt++;
+  e = zswap_find (slot);
+  if (e != NULL)
+  {
+    if (lz_decompress (e->data, e->size, kaddr, PGSIZE) != PGSIZE)
+      PANIC ("swap cache: corrupt entry for slot %zu", slot);
+    zswap_remove (e);
+    hit_cnt++;
+  }
+
+  lock_release (&zswap_lock);
+
+  return e != NULL;
+}
+
+/* Forgets any cached copy of swap SLOT. */
+void zswap_invalidate(size_t slot)
+{
+  struct zswap_entry *e;
+
+  if (zswap_page_limit == 0)
+    return;
+
+  lock_acquire (&zswap_lock);
+  e = zswap_find (slot);
+  if (e != NULL)
+    zswap_remove (e);
+  lock_release (&zswap_lock);
+}
+
+/* Prints swap cache statistics. */
+void zswap_print_stats(void)
+{
+  if (zswap_page_limit == 0)
+    return;
+
+  printf ("Swap cache: %lld pages stored, %lld rejected, %lld written back\n",
+          store_cnt, reject_cnt, writeback_cnt);
+  printf ("Swap cache: compression ratio %lld%%, %lld hits in %lld loads\n",
+          stored_bytes != 0 ? store_cnt * PGSIZE * 100 / stored_bytes : 0,
+          hit_cnt, load_cnt);
+}
@@ -0,0 +1,17 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Maximum number of pages of RAM the compressed swap cache may
+   hold, 0 to disable it.  Set by the "-zs" kernel option. */
+extern size_t zswap_page_limit;
+
+void zswap_init(void);
+bool zswap_store(size_t, const void *);
+bool zswap_load(size_t, void *);
+void zswap_invalidate(size_t);
+void zswap_print_stats(void);
+
+#endif